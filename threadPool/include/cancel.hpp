@@ -0,0 +1,58 @@
+#ifndef _CANCEL_H
+#define _CANCEL_H
+
+#include <atomic>
+#include <memory>
+
+// 取消令牌，只能查询是否被取消，由CancelSource产生
+// 默认构造的令牌没有关联的CancelSource，永远不会被取消
+class CancelToken
+{
+public:
+    CancelToken() = default;
+    ~CancelToken() = default;
+
+    // 是否已经请求取消，正在执行的任务可以轮询该接口提前结束
+    bool isCancelled() const
+    {
+        return state_ != nullptr && state_->load(std::memory_order_acquire);
+    }
+
+private:
+    friend class CancelSource;
+    explicit CancelToken(std::shared_ptr<std::atomic_bool> state) : state_(std::move(state)) {}
+
+private:
+    std::shared_ptr<std::atomic_bool> state_;   // 与CancelSource共享的取消标志
+};
+
+
+// 取消源，持有者调用cancel()后，所有由它产生的令牌都变为已取消
+class CancelSource
+{
+public:
+    CancelSource() : state_(std::make_shared<std::atomic_bool>(false)) {}
+    ~CancelSource() = default;
+
+    // 请求取消，可以重复调用
+    void cancel()
+    {
+        state_->store(true, std::memory_order_release);
+    }
+
+    bool isCancelled() const
+    {
+        return state_->load(std::memory_order_acquire);
+    }
+
+    // 产生一个与当前取消源关联的令牌
+    CancelToken token() const
+    {
+        return CancelToken(state_);
+    }
+
+private:
+    std::shared_ptr<std::atomic_bool> state_;
+};
+
+#endif
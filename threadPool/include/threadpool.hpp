@@ -15,6 +15,7 @@
 #include <future>
 
 #include "any.hpp"
+#include "cancel.hpp"
 
 #define TASK_MAX_THRESHOLD 1024
 #define THREAD_MAX_THRESHOLD 50
@@ -22,21 +23,64 @@
 #define FOR(i, size) for(int i=0; i<size; i++)
 
 
-class Result;
+// 任务的完成状态
+enum class TaskStatus{
+    PENDING,    // 等待执行或正在执行
+    FINISHED,   // 执行完成
+    CANCELLED,  // 执行前被取消
+    REJECTED,   // 任务队列已满，提交失败
+};
+
+
+// Task与Result共享的完成状态
+// 只有Result持有它的强引用，Result全部析构后，Task就知道没有人再等待结果
+class ResultState
+{
+public:
+    ResultState() = default;
+    ~ResultState() = default;
+
+    // 设置返回值，唤醒等待者
+    void setVal(Any&& any);
+    // 任务被取消，get返回空的Any
+    void setCancelled();
+    // 等待任务结束
+    Any get();
+
+    TaskStatus status() const;
+
+private:
+    Any any_;   // 存储任务返回值
+    std::atomic<TaskStatus> status_{TaskStatus::PENDING};   // 任务完成状态
+    Semaphore sem_; // 线程通信信号量
+};
+
+
 // 任务抽象基类
 class Task{
 public:
-    Task(): res_(nullptr) {}
+    Task() = default;
     ~Task() = default;
     // 定义为纯虚函数，用户可以重写run方法实现自定义任务处理
     virtual Any run() = 0;
 
     void exec();
-    void setRes(Result* res);
+    void setRes(std::weak_ptr<ResultState> res);
+
+    // 取消任务，不执行run，通知Result
+    void cancel();
+    void setToken(CancelToken token);
+
+    // 任务是否被请求取消，run中可以轮询它提前结束
+    bool isCancelled() const;
+
+    // 所有Result都已析构，没有人等待结果，任务不需要执行
+    bool isAbandoned() const;
 
 private:
-    // Result中也有Task对象
-    Result* res_;    // 不能写为智能指针，会造成循环引用
+    // Result持有完成状态，Task只保存弱引用，不会造成循环引用，也不会访问已析构的Result
+    std::weak_ptr<ResultState> res_;
+    CancelToken token_; // 取消令牌
 };
 
 
@@ -55,13 +99,13 @@ public:
     Result(Result&&) = default;
     Result& operator= (Result&&) = default; 
 
-    // 等待任务执行完成设置any_
-    void setVal(Any&& any);
+    // 等待任务执行完成，返回任务的返回值
     Any get();
 
+    TaskStatus status() const;
+
  private:
-    Any any_;   // 存储任务返回值
-    Semaphore sem_; // 线程通信信号量
+    std::shared_ptr<ResultState> state_;    // 与Task共享的完成状态
     std::shared_ptr<Task> task_;
 };
 
@@ -107,8 +151,8 @@ public:
     // 设置线程数量的最大阈值
     void setThreadMaxThreshold(int threshold);
 
-    // 给线程池提交任务
-    std::shared_ptr<Result> submitTask(std::shared_ptr<Task> task);
+    // 给线程池提交任务，令牌被取消后，还在队列中的任务不再执行
+    std::shared_ptr<Result> submitTask(std::shared_ptr<Task> task, CancelToken token = CancelToken());
 
     // 开启线程池
     void start(int initThreadSize = std::thread::hardware_concurrency());
@@ -68,18 +68,22 @@ void ThreadPool::start(int initThreadSize)
         threads_.emplace(uPtr->getId(), std::move(uPtr));    // unique_ptr不允许拷贝构造函数，需要右值引用传递，交换资源
     }
 
-    // 启动所有线程
-    FOR(i, initThreadSize_)
+    // 启动所有线程，线程id全局递增，同一进程中的第二个线程池不是从0开始，按容器遍历
+    for (auto& item : threads_)
     {
-        threads_[i]->start();   // 要执行线程函数
+        item.second->start();   // 要执行线程函数
         idleThreadSize_++;
     }
 }
 
 
-std::shared_ptr<Result> ThreadPool::submitTask(std::shared_ptr<Task> task)
+std::shared_ptr<Result> ThreadPool::submitTask(std::shared_ptr<Task> task, CancelToken token)
 {
-    std::make_shared<Task> task()
+    task->setToken(std::move(token));
+
+    // 任务入队前创建Result，Task才能拿到完成状态，否则会被线程当作无人等待而跳过
+    auto res = std::make_shared<Result>(task);
+
     // 获取锁
     std::unique_lock<std::mutex> lock(taskQueMtx_);
 
@@ -110,7 +114,7 @@ std::shared_ptr<Result> ThreadPool::submitTask(std::shared_ptr<Task> task)
     }
 
     // 返回任务的Reslt对象
-    return std::make_shared<Result>(task);
+    return res;
 }
 
 
@@ -186,7 +190,19 @@ void ThreadPool::threadFunc(int threadId)
         // 运行任务
         if (task != nullptr)
         {
-            task->exec();
+            if (task->isAbandoned())
+            {
+                // 返回的Result已全部析构，没有人等待结果，直接跳过
+            }
+            else if (task->isCancelled())
+            {
+                // 任务在队列中被取消，不再执行
+                task->cancel();
+            }
+            else
+            {
+                task->exec();
+            }
         }
         lastLime = std::chrono::high_resolution_clock().now();  // 更新线程执行完的调度时间
         idleThreadSize_++;
@@ -229,17 +245,11 @@ Result::Result(std::shared_ptr<Task> task) : task_(task)
 {
     if (task != nullptr)
     {
-        task->setRes(this);
+        state_ = std::make_shared<ResultState>();
+        task->setRes(state_);
     }
 }
 
-void Result::setVal(Any&& any)
-{
-    any_ = std::forward<Any>(any);  // 完美转发
-    // any_ = std::move(any);
-    sem_.post();
-}
-
 
 Any Result::get()
 {
@@ -248,6 +258,44 @@ Any Result::get()
         return "";
     }
     // 任务如果没执行完，会在此阻塞
+    return state_->get();
+}
+
+
+TaskStatus Result::status() const
+{
+    if (state_ == nullptr)
+    {
+        return TaskStatus::REJECTED;
+    }
+    return state_->status();
+}
+
+
+void ResultState::setVal(Any&& any)
+{
+    any_ = std::forward<Any>(any);  // 完美转发
+    // any_ = std::move(any);
+    status_ = TaskStatus::FINISHED;
+    sem_.post();
+}
+
+
+void ResultState::setCancelled()
+{
+    status_ = TaskStatus::CANCELLED;
+    sem_.post();
+}
+
+
+TaskStatus ResultState::status() const
+{
+    return status_;
+}
+
+
+Any ResultState::get()
+{
     sem_.wait();
 
     // 返回值
@@ -256,14 +304,40 @@ Any Result::get()
 
 void Task::exec()
 {
-    if (res_ != nullptr)
+    // 执行期间持有完成状态，即使Result在此期间析构，返回值也能安全写入
+    auto res = res_.lock();
+    if (res != nullptr)
     {
         // 多态调用，设置返回值
-        res_->setVal(run());
+        res->setVal(run());
     }
 }
 
-void Task::setRes(Result* res)
+void Task::setRes(std::weak_ptr<ResultState> res)
+{
+    res_ = std::move(res);
+}
+
+void Task::cancel()
+{
+    auto res = res_.lock();
+    if (res != nullptr)
+    {
+        res->setCancelled();
+    }
+}
+
+void Task::setToken(CancelToken token)
+{
+    token_ = std::move(token);
+}
+
+bool Task::isCancelled() const
+{
+    return token_.isCancelled();
+}
+
+bool Task::isAbandoned() const
 {
-    res_ = res;
+    return res_.expired();
 }
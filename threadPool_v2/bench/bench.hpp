@@ -0,0 +1,307 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+// 线程池基准测试的公共部分，v1和v2各自实现一个适配器(Adapter)，测试代码对两者完全相同
+// Adapter需要提供：
+//   static const char* name();
+//   Adapter(int threadSize, bool cached, int taskQueSize);
+//   using Handle = ...;                       提交任务后返回的句柄
+//   Handle submitEmpty();                     空任务
+//   Handle submitWork(int iterations);        计算任务
+//   Handle submitSleep(int micros);           模拟阻塞的任务
+//   static long wait(Handle& handle);         等待任务结束并返回结果
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using BenchClock = std::chrono::steady_clock;
+
+// 计算任务，返回值避免被编译器优化掉
+inline long benchWork(int iterations)
+{
+    volatile long sum = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        sum += i ^ (sum >> 3);
+    }
+    return sum;
+}
+
+inline double elapsedNs(BenchClock::time_point begin)
+{
+    return std::chrono::duration<double, std::nano>(BenchClock::now() - begin).count();
+}
+
+inline double percentile(std::vector<double>& values, double p)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    return values[index];
+}
+
+inline double median(std::vector<double> values)
+{
+    return percentile(values, 0.5);
+}
+
+
+// 以JSON数组形式收集测试结果，每条结果是一个扁平的对象
+class BenchReport
+{
+public:
+    explicit BenchReport(const char* version) : version_(version) {}
+
+    // 开始一条结果
+    BenchReport& begin(const char* bench)
+    {
+        if (!entries_.empty())
+        {
+            entries_.back() += "}";
+        }
+        entries_.push_back(std::string("{\"bench\":\"") + bench + "\"");
+        return *this;
+    }
+
+    BenchReport& field(const char* key, int value)
+    {
+        entries_.back() += std::string(",\"") + key + "\":" + std::to_string(value);
+        return *this;
+    }
+
+    BenchReport& field(const char* key, double value)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.3f", value);
+        entries_.back() += std::string(",\"") + key + "\":" + buf;
+        return *this;
+    }
+
+    BenchReport& field(const char* key, const char* value)
+    {
+        entries_.back() += std::string(",\"") + key + "\":\"" + value + "\"";
+        return *this;
+    }
+
+    std::string json() const
+    {
+        std::ostringstream out;
+        out << "{\"version\":\"" << version_ << "\",\"hardware_concurrency\":"
+            << std::thread::hardware_concurrency() << ",\"results\":[";
+        for (size_t i = 0; i < entries_.size(); i++)
+        {
+            out << (i == 0 ? "\n" : ",\n") << entries_[i] << (i + 1 == entries_.size() ? "}" : "");
+        }
+        out << "\n]}\n";
+        return out.str();
+    }
+
+private:
+    std::string version_;
+    std::vector<std::string> entries_;
+};
+
+
+// 测试规模，--quick时缩小，便于在CI中快速检查
+struct BenchConfig
+{
+    int repeat = 3;             // 每项重复次数，取中位数
+    int throughputTasks = 100000;
+    int latencySamples = 20000;
+    int fanOutRounds = 200;
+    int fanOutWidth = 64;
+    int burstTasks = 200;
+};
+
+
+// 空任务吞吐量：producers个线程同时提交，consumers个工作线程执行
+template<typename Adapter>
+void benchThroughput(BenchReport& report, const BenchConfig& config)
+{
+    int producerSizes[] = {1, 2, 4};
+    int consumerSizes[] = {1, 2, 4, 8};
+    for (int producers : producerSizes)
+    {
+        for (int consumers : consumerSizes)
+        {
+            std::vector<double> rates;
+            for (int r = 0; r < config.repeat; r++)
+            {
+                Adapter pool(consumers, false, config.throughputTasks);
+                int perProducer = config.throughputTasks / producers;
+                auto begin = BenchClock::now();
+                std::vector<std::thread> threads;
+                for (int p = 0; p < producers; p++)
+                {
+                    threads.emplace_back([&]() {
+                        std::vector<typename Adapter::Handle> handles;
+                        handles.reserve(perProducer);
+                        for (int i = 0; i < perProducer; i++)
+                        {
+                            handles.push_back(pool.submitEmpty());
+                        }
+                        for (auto& handle : handles)
+                        {
+                            Adapter::wait(handle);
+                        }
+                    });
+                }
+                for (auto& t : threads)
+                {
+                    t.join();
+                }
+                rates.push_back(perProducer * producers / (elapsedNs(begin) / 1e9));
+            }
+            report.begin("throughput_empty").field("producers", producers).field("consumers", consumers)
+                .field("tasks_per_sec", median(rates));
+        }
+    }
+}
+
+
+// 单次submit调用的耗时，不等待任务执行
+template<typename Adapter>
+void benchSubmitLatency(BenchReport& report, const BenchConfig& config)
+{
+    Adapter pool(4, false, config.latencySamples);
+    std::vector<typename Adapter::Handle> handles;
+    handles.reserve(config.latencySamples);
+    std::vector<double> samples;
+    samples.reserve(config.latencySamples);
+    for (int i = 0; i < config.latencySamples; i++)
+    {
+        auto begin = BenchClock::now();
+        handles.push_back(pool.submitEmpty());
+        samples.push_back(elapsedNs(begin));
+    }
+    for (auto& handle : handles)
+    {
+        Adapter::wait(handle);
+    }
+    report.begin("submit_latency").field("p50_ns", percentile(samples, 0.5))
+        .field("p99_ns", percentile(samples, 0.99)).field("p999_ns", percentile(samples, 0.999));
+}
+
+
+// 提交一个空任务并等待结果的往返时间
+template<typename Adapter>
+void benchRoundTrip(BenchReport& report, const BenchConfig& config)
+{
+    Adapter pool(2, false, 1024);
+    std::vector<double> samples;
+    samples.reserve(config.latencySamples);
+    for (int i = 0; i < config.latencySamples; i++)
+    {
+        auto begin = BenchClock::now();
+        auto handle = pool.submitEmpty();
+        Adapter::wait(handle);
+        samples.push_back(elapsedNs(begin));
+    }
+    report.begin("get_round_trip").field("p50_ns", percentile(samples, 0.5))
+        .field("p99_ns", percentile(samples, 0.99)).field("p999_ns", percentile(samples, 0.999));
+}
+
+
+// 扇出扇入：一次提交fanOutWidth个计算任务，全部完成后进入下一轮
+template<typename Adapter>
+void benchFanOut(BenchReport& report, const BenchConfig& config)
+{
+    int threadSize = std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+    Adapter pool(threadSize, false, config.fanOutWidth);
+    std::vector<double> rounds;
+    for (int r = 0; r < config.fanOutRounds; r++)
+    {
+        auto begin = BenchClock::now();
+        std::vector<typename Adapter::Handle> handles;
+        for (int i = 0; i < config.fanOutWidth; i++)
+        {
+            handles.push_back(pool.submitWork(2000));
+        }
+        for (auto& handle : handles)
+        {
+            Adapter::wait(handle);
+        }
+        rounds.push_back(elapsedNs(begin));
+    }
+    report.begin("fan_out_fan_in").field("threads", threadSize).field("width", config.fanOutWidth)
+        .field("p50_us", percentile(rounds, 0.5) / 1000).field("p99_us", percentile(rounds, 0.99) / 1000);
+}
+
+
+// cached模式的突发响应：2个初始线程，突然提交burstTasks个阻塞1ms的任务
+template<typename Adapter>
+void benchCachedBurst(BenchReport& report, const BenchConfig& config)
+{
+    std::vector<double> totals;
+    for (int r = 0; r < config.repeat; r++)
+    {
+        Adapter pool(2, true, config.burstTasks);
+        auto begin = BenchClock::now();
+        std::vector<typename Adapter::Handle> handles;
+        for (int i = 0; i < config.burstTasks; i++)
+        {
+            handles.push_back(pool.submitSleep(1000));
+        }
+        for (auto& handle : handles)
+        {
+            Adapter::wait(handle);
+        }
+        totals.push_back(elapsedNs(begin));
+    }
+    report.begin("cached_burst").field("tasks", config.burstTasks).field("task_us", 1000)
+        .field("total_ms", median(totals) / 1e6);
+}
+
+
+// 运行全部测试，argv[1]为结果文件路径，--quick缩小测试规模
+// extra为只有某个版本支持的测试，在公共测试之后运行
+template<typename Adapter>
+int benchMain(int argc, char** argv, std::function<void(BenchReport&, const BenchConfig&)> extra = nullptr)
+{
+    BenchConfig config;
+    std::string path = std::string("bench_") + Adapter::name() + ".json";
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--quick") == 0)
+        {
+            config.repeat = 1;
+            config.throughputTasks = 10000;
+            config.latencySamples = 2000;
+            config.fanOutRounds = 20;
+            config.burstTasks = 50;
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    BenchReport report(Adapter::name());
+    benchThroughput<Adapter>(report, config);
+    benchSubmitLatency<Adapter>(report, config);
+    benchRoundTrip<Adapter>(report, config);
+    benchFanOut<Adapter>(report, config);
+    benchCachedBurst<Adapter>(report, config);
+    if (extra != nullptr)
+    {
+        extra(report, config);
+    }
+
+    std::ofstream out(path);
+    out << report.json();
+    fprintf(stderr, "%s benchmark written to %s\n", Adapter::name(), path.c_str());
+    return out ? 0 : 1;
+}
+
+#endif
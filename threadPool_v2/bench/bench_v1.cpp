@@ -0,0 +1,90 @@
+// threadPool(v1)的基准测试，任务继承Task，通过Result::get等待结果
+#include "threadpool.hpp"
+#include "bench.hpp"
+
+class EmptyTask : public Task
+{
+public:
+    Any run() override
+    {
+        return 0L;
+    }
+};
+
+
+class WorkTask : public Task
+{
+public:
+    explicit WorkTask(int iterations) : iterations_(iterations) {}
+
+    Any run() override
+    {
+        return benchWork(iterations_);
+    }
+
+private:
+    int iterations_;
+};
+
+
+class SleepTask : public Task
+{
+public:
+    explicit SleepTask(int micros) : micros_(micros) {}
+
+    Any run() override
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(micros_));
+        return 0L;
+    }
+
+private:
+    int micros_;
+};
+
+
+class V1Adapter
+{
+public:
+    using Handle = std::shared_ptr<Result>;
+
+    static const char* name()
+    {
+        return "v1";
+    }
+
+    V1Adapter(int threadSize, bool cached, int taskQueSize)
+        : pool_(taskQueSize, THREAD_MAX_THRESHOLD, cached ? PoolMode::MODE_CACHED : PoolMode::MODE_FIXED)
+    {
+        pool_.start(threadSize);
+    }
+
+    Handle submitEmpty()
+    {
+        return pool_.submitTask(std::make_shared<EmptyTask>());
+    }
+
+    Handle submitWork(int iterations)
+    {
+        return pool_.submitTask(std::make_shared<WorkTask>(iterations));
+    }
+
+    Handle submitSleep(int micros)
+    {
+        return pool_.submitTask(std::make_shared<SleepTask>(micros));
+    }
+
+    static long wait(Handle& handle)
+    {
+        return handle->get().cast<long>();
+    }
+
+private:
+    ThreadPool pool_;
+};
+
+
+int main(int argc, char** argv)
+{
+    return benchMain<V1Adapter>(argc, argv);
+}
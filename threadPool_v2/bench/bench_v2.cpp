@@ -0,0 +1,86 @@
+// threadPool_v2的基准测试，提交任意可调用对象，通过future::get等待结果
+#include "threadpool.hpp"
+#include "bench.hpp"
+
+class V2Adapter
+{
+public:
+    using Handle = std::future<long>;
+
+    static const char* name()
+    {
+        return "v2";
+    }
+
+    V2Adapter(int threadSize, bool cached, int taskQueSize)
+        : pool_(taskQueSize, THREAD_MAX_THRESHOLD, cached ? PoolMode::MODE_CACHED : PoolMode::MODE_FIXED)
+    {
+        pool_.start(threadSize);
+    }
+
+    Handle submitEmpty()
+    {
+        return pool_.submitTask([]() { return 0L; });
+    }
+
+    Handle submitWork(int iterations)
+    {
+        return pool_.submitTask(benchWork, iterations);
+    }
+
+    Handle submitSleep(int micros)
+    {
+        return pool_.submitTask([micros]() {
+            std::this_thread::sleep_for(std::chrono::microseconds(micros));
+            return 0L;
+        });
+    }
+
+    static long wait(Handle& handle)
+    {
+        return handle.get();
+    }
+
+private:
+    ThreadPool pool_;
+};
+
+
+// 指标统计的单任务开销：一个工作线程执行空任务，比较关闭和开启指标时平均每个任务的耗时
+// fixed模式下开启指标后每个任务多读两次steady_clock，差值主要是这两次读时钟和三次直方图记录
+static void benchMetricsOverhead(BenchReport& report, const BenchConfig& config)
+{
+    double perTask[2];
+    for (int enabled = 0; enabled < 2; enabled++)
+    {
+        std::vector<double> samples;
+        for (int r = 0; r < config.repeat; r++)
+        {
+            ThreadPool pool(config.throughputTasks, THREAD_MAX_THRESHOLD, PoolMode::MODE_FIXED);
+            pool.setMetricsEnabled(enabled != 0);
+            pool.start(1);
+            std::vector<std::future<long>> handles;
+            handles.reserve(config.throughputTasks);
+            auto begin = BenchClock::now();
+            for (int i = 0; i < config.throughputTasks; i++)
+            {
+                handles.push_back(pool.submitTask([]() { return 0L; }));
+            }
+            for (auto& handle : handles)
+            {
+                handle.get();
+            }
+            samples.push_back(elapsedNs(begin) / config.throughputTasks);
+        }
+        perTask[enabled] = median(samples);
+    }
+    report.begin("metrics_overhead").field("tasks", config.throughputTasks)
+        .field("off_ns_per_task", perTask[0]).field("on_ns_per_task", perTask[1])
+        .field("overhead_ns", perTask[1] - perTask[0]).field("extra_clock_reads_per_task", 2);
+}
+
+
+int main(int argc, char** argv)
+{
+    return benchMain<V2Adapter>(argc, argv, benchMetricsOverhead);
+}
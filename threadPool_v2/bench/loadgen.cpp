@@ -0,0 +1,236 @@
+// 开环负载生成器：按泊松过程或回放的到达间隔提交任务，提交速率与任务完成速度无关
+// 延迟从计划到达时间开始计算（修正coordinated omission），提交被队列阻塞的时间也计入延迟
+// 对FIXED/CACHED两种模式和不同任务队列上限，输出延迟-吞吐量曲线(JSON)
+//
+// 用法：bench_loadgen [输出文件] [--quick] [--threads N] [--service const|exp|bimodal]
+//                     [--mean-us 平均服务时间] [--replay 到达间隔文件(每行一个微秒数)]
+#include "threadpool.hpp"
+#include "bench.hpp"
+
+#include <fstream>
+#include <random>
+
+// 一个任务的时间戳(ns)，计划时间和提交时间由生成线程写，开始和结束时间由工作线程写
+struct LoadSample
+{
+    int64_t intended = 0;   // 计划到达时间
+    int64_t submit = 0;     // 实际调用submitTask的时间
+    int64_t start = 0;      // 开始执行时间，0表示任务被拒绝
+    int64_t finish = 0;     // 执行结束时间
+};
+
+
+struct LoadConfig
+{
+    int threadSize = 4;
+    int meanServiceUs = 50;
+    int durationMs = 1000;      // 每个负载点的持续时间
+    std::string service = "exp";
+    std::vector<double> replay; // 回放的到达间隔(us)，为空时使用泊松过程
+    std::vector<double> loads = {0.1, 0.3, 0.5, 0.7, 0.8, 0.9, 0.95, 1.0, 1.1};    // 相对线程池理论容量的负载
+    std::vector<int> queThresholds = {64, TASK_MAX_THRESHOLD};
+};
+
+
+static int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        BenchClock::now().time_since_epoch()).count();
+}
+
+
+// 忙等模拟计算型服务时间
+static void spinFor(int64_t ns)
+{
+    int64_t end = nowNs() + ns;
+    while (nowNs() < end)
+    {
+    }
+}
+
+
+// 等待到计划时间，距离较远时先睡眠，最后一段忙等以减小误差
+static void waitUntil(int64_t deadline)
+{
+    int64_t remain = deadline - nowNs();
+    if (remain > 200000)
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(remain - 100000));
+    }
+    while (nowNs() < deadline)
+    {
+    }
+}
+
+
+// 生成服务时间(ns)，固定随机种子，每个负载点的工作量相同
+static std::vector<int64_t> makeServiceTimes(const LoadConfig& config, size_t size)
+{
+    std::mt19937_64 rng(42);
+    double mean = config.meanServiceUs * 1000.0;
+    std::exponential_distribution<double> exp(1.0 / mean);
+    std::bernoulli_distribution slow(0.1);
+    std::vector<int64_t> res(size);
+    for (auto& t : res)
+    {
+        if (config.service == "const")
+            t = static_cast<int64_t>(mean);
+        else if (config.service == "bimodal")
+            t = static_cast<int64_t>(slow(rng) ? mean * 5.5 : mean * 0.5);   // 90%短任务，10%长任务，均值不变
+        else
+            t = static_cast<int64_t>(exp(rng));
+    }
+    return res;
+}
+
+
+// 生成相对起点的到达时间(ns)，回放时按目标速率缩放间隔
+static std::vector<int64_t> makeArrivals(const LoadConfig& config, double rate, size_t size)
+{
+    std::mt19937_64 rng(7);
+    std::exponential_distribution<double> exp(rate);
+    double replayMean = 0;
+    for (double gap : config.replay)
+    {
+        replayMean += gap / config.replay.size();
+    }
+    std::vector<int64_t> res(size);
+    double t = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (config.replay.empty())
+            t += exp(rng) * 1e9;
+        else
+            t += config.replay[i % config.replay.size()] / replayMean / rate * 1e9;
+        res[i] = static_cast<int64_t>(t);
+    }
+    return res;
+}
+
+
+// 运行一个负载点，结果追加到report
+static void runPoint(BenchReport& report, const LoadConfig& config, PoolMode mode, int queThreshold, double load)
+{
+    double capacity = config.threadSize * 1e6 / config.meanServiceUs;   // 每秒最多完成的任务数
+    double rate = capacity * load;
+    size_t size = std::max<size_t>(1, static_cast<size_t>(rate * config.durationMs / 1000));
+    std::vector<int64_t> service = makeServiceTimes(config, size);
+    std::vector<int64_t> arrivals = makeArrivals(config, rate, size);
+    std::vector<LoadSample> samples(size);
+    std::vector<std::future<void>> futures;
+    futures.reserve(size);
+
+    {
+        ThreadPool pool(queThreshold, THREAD_MAX_THRESHOLD, mode);
+        pool.start(config.threadSize);
+
+        int64_t begin = nowNs() + 10000000;
+        for (size_t i = 0; i < size; i++)
+        {
+            LoadSample* sample = &samples[i];
+            sample->intended = begin + arrivals[i];
+            waitUntil(sample->intended);
+            sample->submit = nowNs();
+            int64_t ns = service[i];
+            futures.push_back(pool.submitTask([sample, ns]() {
+                sample->start = nowNs();
+                spinFor(ns);
+                sample->finish = nowNs();
+            }));
+        }
+        for (auto& f : futures)
+        {
+            f.get();
+        }
+    }
+
+    std::vector<double> queueWait, response, uncorrected;
+    int64_t first = samples.front().intended, last = first;
+    int rejected = 0;
+    for (auto& s : samples)
+    {
+        if (s.start == 0)
+        {
+            rejected++;
+            continue;
+        }
+        queueWait.push_back((s.start - s.intended) / 1000.0);
+        response.push_back((s.finish - s.intended) / 1000.0);
+        uncorrected.push_back((s.finish - s.submit) / 1000.0);
+        last = std::max(last, s.finish);
+    }
+    double achieved = response.size() / std::max(1e-9, (last - first) / 1e9);
+
+    report.begin("open_loop")
+        .field("mode", mode == PoolMode::MODE_FIXED ? "fixed" : "cached")
+        .field("que_threshold", queThreshold)
+        .field("load", load)
+        .field("offered_per_sec", rate)
+        .field("achieved_per_sec", achieved)
+        .field("rejected", rejected)
+        .field("wait_p50_us", percentile(queueWait, 0.5))
+        .field("wait_p99_us", percentile(queueWait, 0.99))
+        .field("response_p50_us", percentile(response, 0.5))
+        .field("response_p99_us", percentile(response, 0.99))
+        .field("response_p999_us", percentile(response, 0.999))
+        .field("uncorrected_p99_us", percentile(uncorrected, 0.99));
+    fprintf(stderr, "%s que=%d load=%.2f done\n", mode == PoolMode::MODE_FIXED ? "fixed" : "cached", queThreshold, load);
+}
+
+
+int main(int argc, char** argv)
+{
+    LoadConfig config;
+    std::string path = "bench_loadgen.json";
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--quick")
+        {
+            config.durationMs = 200;
+            config.loads = {0.5, 0.9, 1.1};
+        }
+        else if (arg == "--threads" && hasValue)
+            config.threadSize = std::max(1, atoi(argv[++i]));
+        else if (arg == "--service" && hasValue)
+            config.service = argv[++i];
+        else if (arg == "--mean-us" && hasValue)
+            config.meanServiceUs = std::max(1, atoi(argv[++i]));
+        else if (arg == "--replay" && hasValue)
+        {
+            std::ifstream in(argv[++i]);
+            double gap;
+            while (in >> gap)
+            {
+                if (gap > 0)
+                    config.replay.push_back(gap);
+            }
+            if (config.replay.empty())
+            {
+                fprintf(stderr, "replay file %s has no arrivals\n", argv[i]);
+                return 1;
+            }
+        }
+        else
+            path = arg;
+    }
+
+    BenchReport report("v2");
+    PoolMode modes[] = {PoolMode::MODE_FIXED, PoolMode::MODE_CACHED};
+    for (PoolMode mode : modes)
+    {
+        for (int queThreshold : config.queThresholds)
+        {
+            for (double load : config.loads)
+            {
+                runPoint(report, config, mode, queThreshold, load);
+            }
+        }
+    }
+
+    std::ofstream out(path);
+    out << report.json();
+    fprintf(stderr, "load generator results written to %s\n", path.c_str());
+    return out ? 0 : 1;
+}
@@ -0,0 +1,209 @@
+// 可扩展性测试：在绑定的核数1..C和线程池线程数1..N上运行固定的几类负载，结果输出为CSV
+// 每行记录吞吐量、相对单线程的加速比和效率、上下文切换次数(getrusage)和提交耗时
+// 自愿上下文切换主要来自线程阻塞在锁和条件变量上，提交耗时包含获取任务队列锁的时间，两者反映锁竞争
+// 以THREADPOOL_LOCK_PROFILE编译时，另外记录任务队列锁的竞争次数和等待时间，否则这两列为空
+// 只支持Linux（sched_setaffinity）
+//
+// 用法：bench_scaling [输出文件] [--quick] [--max-threads N]
+#include "threadpool.hpp"
+#include "bench.hpp"
+
+#include <sched.h>
+#include <sys/resource.h>
+
+#define SCALING_BUFFER_SIZE (64 << 20)  // 内存型负载遍历的缓冲区大小，远大于缓存
+#define SCALING_CHUNK_SIZE (1 << 20)    // 每个内存型任务遍历的字节数
+
+static std::vector<int64_t> streamBuffer(SCALING_BUFFER_SIZE / sizeof(int64_t), 1);
+
+// 内存型任务：顺序读取缓冲区中的一段
+static long streamSum(int chunk)
+{
+    const size_t size = SCALING_CHUNK_SIZE / sizeof(int64_t);
+    size_t chunks = streamBuffer.size() / size;
+    const int64_t* data = streamBuffer.data() + (chunk % chunks) * size;
+    long sum = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        sum += data[i];
+    }
+    return sum;
+}
+
+// IO型任务：和main.cpp中的sum一样阻塞等待，时间缩短为1ms
+static long sleepTask()
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return 0;
+}
+
+
+struct Workload
+{
+    const char* name;
+    int tasks;
+};
+
+static std::future<long> submitWorkload(ThreadPool& pool, const std::string& name, int i)
+{
+    if (name == "cpu" || (name == "mixed" && i % 3 == 0))
+        return pool.submitTask(benchWork, 20000);
+    if (name == "memory" || (name == "mixed" && i % 3 == 1))
+        return pool.submitTask(streamSum, i);
+    return pool.submitTask(sleepTask);
+}
+
+
+// 把当前进程绑定到可用CPU中的前cores个，之后创建的线程继承该设置
+static void pinCores(const std::vector<int>& cpus, int cores)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < cores; i++)
+    {
+        CPU_SET(cpus[i], &set);
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+
+struct RunResult
+{
+    double seconds;
+    long volCsw;      // 自愿上下文切换次数
+    long involCsw;    // 非自愿上下文切换次数
+    double submitNs;  // 平均每次submitTask的耗时
+    std::string lockContended;  // 任务队列锁的竞争次数
+    std::string lockWaitP99;    // 所有调用点中最大的等待时间p99(ns)
+};
+
+static RunResult runOnce(const Workload& workload, int threadSize)
+{
+    ThreadPool pool(workload.tasks, THREAD_MAX_THRESHOLD, PoolMode::MODE_FIXED);
+    pool.start(threadSize);
+
+    rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    std::vector<std::future<long>> futures;
+    futures.reserve(workload.tasks);
+    double submitNs = 0;
+    auto begin = BenchClock::now();
+    for (int i = 0; i < workload.tasks; i++)
+    {
+        auto submitBegin = BenchClock::now();
+        futures.push_back(submitWorkload(pool, workload.name, i));
+        submitNs += elapsedNs(submitBegin);
+    }
+    for (auto& f : futures)
+    {
+        f.get();
+    }
+    RunResult res;
+    res.seconds = elapsedNs(begin) / 1e9;
+    getrusage(RUSAGE_SELF, &after);
+    res.volCsw = after.ru_nvcsw - before.ru_nvcsw;
+    res.involCsw = after.ru_nivcsw - before.ru_nivcsw;
+    res.submitNs = submitNs / workload.tasks;
+
+    std::vector<LockSiteReport> profile = pool.lockProfile();
+    if (!profile.empty())
+    {
+        uint64_t contended = 0, waitP99 = 0;
+        for (auto& site : profile)
+        {
+            contended += site.contended;
+            waitP99 = std::max(waitP99, site.wait.p99);
+        }
+        res.lockContended = std::to_string(contended);
+        res.lockWaitP99 = std::to_string(waitP99);
+    }
+    return res;
+}
+
+
+// 1, 2, 4 ... 直到max，max本身总会被包含
+static std::vector<int> sweep(int max)
+{
+    std::vector<int> res;
+    for (int i = 1; i < max; i *= 2)
+    {
+        res.push_back(i);
+    }
+    res.push_back(max);
+    return res;
+}
+
+
+int main(int argc, char** argv)
+{
+    std::string path = "bench_scaling.csv";
+    bool quick = false;
+    int maxThreads = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--quick")
+            quick = true;
+        else if (arg == "--max-threads" && i + 1 < argc)
+            maxThreads = std::max(1, atoi(argv[++i]));
+        else
+            path = arg;
+    }
+
+    // 当前进程允许使用的CPU
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    std::vector<int> cpus;
+    for (int i = 0; i < CPU_SETSIZE; i++)
+    {
+        if (CPU_ISSET(i, &allowed))
+            cpus.push_back(i);
+    }
+    int maxCores = static_cast<int>(cpus.size());
+    if (maxThreads == 0)
+        maxThreads = 2 * maxCores;
+
+    int scale = quick ? 10 : 1;
+    Workload workloads[] = {
+        {"cpu", 4000 / scale},
+        {"memory", 1000 / scale},
+        {"io", 2000 / scale},
+        {"mixed", 3000 / scale},
+    };
+
+    FILE* out = fopen(path.c_str(), "w");
+    if (out == nullptr)
+    {
+        fprintf(stderr, "cannot open %s\n", path.c_str());
+        return 1;
+    }
+    fprintf(out, "workload,cores,threads,tasks,seconds,throughput,speedup,efficiency,vol_csw,invol_csw,submit_ns,lock_contended,lock_wait_p99_ns\n");
+
+    for (int cores : sweep(maxCores))
+    {
+        pinCores(cpus, cores);
+        for (auto& workload : workloads)
+        {
+            runOnce(workload, 1);   // 预热，结果丢弃
+            double baseSeconds = 0;
+            for (int threads : sweep(maxThreads))
+            {
+                RunResult res = runOnce(workload, threads);
+                if (threads == 1)
+                    baseSeconds = res.seconds;
+                double speedup = baseSeconds / res.seconds;
+                fprintf(out, "%s,%d,%d,%d,%.6f,%.1f,%.3f,%.3f,%ld,%ld,%.1f,%s,%s\n",
+                    workload.name, cores, threads, workload.tasks, res.seconds, workload.tasks / res.seconds,
+                    speedup, speedup / threads, res.volCsw, res.involCsw, res.submitNs,
+                    res.lockContended.c_str(), res.lockWaitP99.c_str());
+                fflush(out);
+            }
+            fprintf(stderr, "%s on %d cores done\n", workload.name, cores);
+        }
+    }
+    pinCores(cpus, maxCores);
+
+    fclose(out);
+    fprintf(stderr, "scaling results written to %s\n", path.c_str());
+    return 0;
+}
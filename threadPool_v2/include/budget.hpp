@@ -0,0 +1,52 @@
+#ifndef _BUDGET_H
+#define _BUDGET_H
+
+#include <mutex>
+#include <vector>
+
+class ThreadPool;
+
+
+// 多个线程池共享的线程数量预算，一个许可对应一个工作线程
+// 线程池在start前用setBudget注册，启动、cached模式扩容和resize都要先申请许可，线程退出后归还
+// 许可不足时，通知其他cached模式的线程池立即回收超过最小线程数量的空闲线程，把许可让给有排队任务的线程池
+// 每个线程池至少保留一个许可，保证都能执行任务；阻塞区补偿的线程不占用许可
+// 预算必须比注册的线程池活得更久
+class ThreadBudget
+{
+public:
+    explicit ThreadBudget(int permits);
+    ~ThreadBudget() = default;
+
+    ThreadBudget(const ThreadBudget&) = delete;
+    ThreadBudget& operator=(const ThreadBudget&) = delete;
+
+    // 进程内默认的预算，许可数量为CPU核数
+    static ThreadBudget& process();
+
+    // 调整许可数量，已发放的许可不收回，线程池缩容后不再发放超出的部分
+    void setPermits(int permits);
+
+    int permits();
+    // 已发放的许可数量
+    int used();
+
+private:
+    friend class ThreadPool;
+
+    void attach(ThreadPool* pool);
+    void detach(ThreadPool* pool);
+
+    // 申请count个许可，返回实际得到的数量，force为true时允许超出预算
+    // 不足时通知其他线程池回收空闲线程，调用者之后再次申请
+    int acquire(ThreadPool* pool, int count, bool force);
+    void release(int count);
+
+private:
+    std::mutex mtx_;    // 保护以下成员，持有时不获取线程池的锁
+    int permits_;
+    int used_;
+    std::vector<ThreadPool*> pools_;
+};
+
+#endif
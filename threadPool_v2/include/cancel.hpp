@@ -0,0 +1,104 @@
+#ifndef _CANCEL_H
+#define _CANCEL_H
+
+#include <atomic>
+#include <memory>
+#include <exception>
+
+// 任务在执行前被取消时，等待者从future中拿到该异常
+class TaskCancelled : public std::exception
+{
+public:
+    const char* what() const noexcept override
+    {
+        return "task cancelled";
+    }
+};
+
+
+// 任务执行超过设置的超时时间后，等待者从future中拿到该异常
+// 任务本身仍在线程中运行，完成后的返回值会被丢弃
+class TaskTimeout : public std::exception
+{
+public:
+    const char* what() const noexcept override
+    {
+        return "task timeout";
+    }
+};
+
+
+// 开启丢弃过期任务后，取出时已经超过截止时间的任务不再执行，等待者从future中拿到该异常
+class DeadlineExpired : public std::exception
+{
+public:
+    const char* what() const noexcept override
+    {
+        return "task deadline expired";
+    }
+};
+
+
+// 排队时间过长时，线程池按CoDel规则从队头丢弃的任务，等待者从future中拿到该异常
+class TaskDropped : public std::exception
+{
+public:
+    const char* what() const noexcept override
+    {
+        return "task dropped by load shedding";
+    }
+};
+
+
+// 取消令牌，只能查询是否被取消，由CancelSource产生
+// 默认构造的令牌没有关联的CancelSource，永远不会被取消
+class CancelToken
+{
+public:
+    CancelToken() = default;
+    ~CancelToken() = default;
+
+    // 是否已经请求取消，正在执行的任务可以轮询该接口提前结束
+    bool isCancelled() const
+    {
+        return state_ != nullptr && state_->load(std::memory_order_acquire);
+    }
+
+private:
+    friend class CancelSource;
+    explicit CancelToken(std::shared_ptr<std::atomic_bool> state) : state_(std::move(state)) {}
+
+private:
+    std::shared_ptr<std::atomic_bool> state_;   // 与CancelSource共享的取消标志
+};
+
+
+// 取消源，持有者调用cancel()后，所有由它产生的令牌都变为已取消
+class CancelSource
+{
+public:
+    CancelSource() : state_(std::make_shared<std::atomic_bool>(false)) {}
+    ~CancelSource() = default;
+
+    // 请求取消，可以重复调用
+    void cancel()
+    {
+        state_->store(true, std::memory_order_release);
+    }
+
+    bool isCancelled() const
+    {
+        return state_->load(std::memory_order_acquire);
+    }
+
+    // 产生一个与当前取消源关联的令牌
+    CancelToken token() const
+    {
+        return CancelToken(state_);
+    }
+
+private:
+    std::shared_ptr<std::atomic_bool> state_;
+};
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef _EXECUTOR_H
+#define _EXECUTOR_H
+
+#include "threadpool.hpp"
+
+#define EXECUTOR_IO_MIN_THREADS 4       // IO线程池常驻的线程数量
+#define EXECUTOR_IO_MAX_THREADS 256     // IO线程池的最大线程数量
+
+
+// 任务链中一个阶段的完成状态，完成后在完成它的线程中依次调度登记的后续阶段
+template<typename T>
+struct StageState
+{
+    StageState() : result(promise.get_future().share()), done(false) {}
+
+    std::promise<T> promise;
+    std::shared_future<T> result;
+    std::atomic_bool done;  // 保证结果只被设置一次
+
+    std::mutex mtx;         // 保护ready和next
+    bool ready = false;
+    std::vector<std::function<void()>> next;
+
+    // 执行func设置结果，返回值和异常都保存在result中，然后调度后续阶段
+    template<typename Func>
+    void run(Func& func)
+    {
+        try
+        {
+            invokeTask(promise, func, done);
+        }
+        catch (...)
+        {
+            if (!done.exchange(true))
+            {
+                promise.set_exception(std::current_exception());
+            }
+        }
+        complete();
+    }
+
+    // 阶段没有执行（被取消或丢弃），以异常结束，后续阶段取结果时重新抛出
+    void fail(std::exception_ptr e)
+    {
+        if (!done.exchange(true))
+        {
+            promise.set_exception(e);
+        }
+        complete();
+    }
+
+    // 标记完成并调度登记的后续阶段
+    void complete()
+    {
+        std::vector<std::function<void()>> callbacks;
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            ready = true;
+            callbacks.swap(next);
+        }
+        for (auto& callback : callbacks)
+        {
+            callback();
+        }
+    }
+
+    // 登记后续阶段，已经完成时立即在当前线程调度
+    void then(std::function<void()> callback)
+    {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            if (!ready)
+            {
+                next.push_back(std::move(callback));
+                return;
+            }
+        }
+        callback();
+    }
+};
+
+
+// 用上一阶段的结果调用后续阶段，void结果的后续阶段没有参数
+template<typename T, typename Func>
+struct StageCall
+{
+    using type = decltype(std::declval<Func&>()(std::declval<const T&>()));
+
+    static type call(Func& func, const std::shared_future<T>& input)
+    {
+        return func(input.get());
+    }
+};
+
+template<typename Func>
+struct StageCall<void, Func>
+{
+    using type = decltype(std::declval<Func&>()());
+
+    static type call(Func& func, const std::shared_future<void>& input)
+    {
+        input.get();
+        return func();
+    }
+};
+
+
+class Executor;
+
+
+// 提交到Executor的任务的结果，可以用thenCpu/thenIo把后续处理提交到另一个线程池
+// 上一阶段抛出的异常在后续阶段取结果时重新抛出，沿任务链传递到最后一个阶段
+template<typename T>
+class Stage
+{
+public:
+    // 结果，可以多次获取
+    std::shared_future<T> future() const { return state_->result; }
+
+    // 等待并获取结果，任务抛出的异常在这里重新抛出
+    decltype(auto) get() const { return state_->result.get(); }
+
+    // 完成后把func提交到CPU线程池，参数为本阶段的结果
+    template<typename Func>
+    auto thenCpu(Func&& func) -> Stage<typename StageCall<T, typename std::decay<Func>::type>::type>;
+
+    // 完成后把func提交到IO线程池，参数为本阶段的结果
+    template<typename Func>
+    auto thenIo(Func&& func) -> Stage<typename StageCall<T, typename std::decay<Func>::type>::type>;
+
+private:
+    friend class Executor;
+    template<typename U> friend class Stage;
+
+    Stage(Executor* executor, std::shared_ptr<StageState<T>> state) : executor_(executor), state_(std::move(state)) {}
+
+    template<typename Func>
+    auto then(ThreadPool* pool, Func&& func) -> Stage<typename StageCall<T, typename std::decay<Func>::type>::type>;
+
+    Executor* executor_;
+    std::shared_ptr<StageState<T>> state_;
+};
+
+
+// CPU和IO分离的执行器
+// CPU线程池为fixed模式，线程数量等于可用的CPU核数；IO线程池为cached模式，线程数量随阻塞的任务增长
+// 阻塞的任务提交到IO线程池，不占用计算线程，计算任务不会排在阻塞的任务后面
+// 析构时等待所有已提交的阶段（包括它们调度的后续阶段）执行完
+class Executor
+{
+public:
+    explicit Executor(int cpuThreads = effectiveCores(), int ioMaxThreads = EXECUTOR_IO_MAX_THREADS);
+    ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // 提交计算任务
+    template<typename Func, typename... Types>
+    auto submitCpu(Func&& func, Types&&... paras) -> Stage<decltype(func(paras...))>
+    {
+        return submit(&cpu_, std::bind(std::forward<Func>(func), std::forward<Types>(paras)...));
+    }
+
+    // 提交阻塞IO任务
+    template<typename Func, typename... Types>
+    auto submitIo(Func&& func, Types&&... paras) -> Stage<decltype(func(paras...))>
+    {
+        return submit(&io_, std::bind(std::forward<Func>(func), std::forward<Types>(paras)...));
+    }
+
+    ThreadPool& cpuPool() { return cpu_; }
+    ThreadPool& ioPool() { return io_; }
+
+    // 当前进程可以使用的CPU核数（考虑CPU亲和性）
+    static int effectiveCores();
+
+private:
+    template<typename U> friend class Stage;
+
+    template<typename Func>
+    auto submit(ThreadPool* pool, Func&& func) -> Stage<decltype(func())>
+    {
+        using returnType = decltype(func());
+        auto state = std::make_shared<StageState<returnType>>();
+        auto task = std::make_shared<typename std::decay<Func>::type>(std::forward<Func>(func));
+        schedule(pool, [state, task]() { state->run(*task); }, [state](std::exception_ptr e) { state->fail(e); });
+        return Stage<returnType>(this, state);
+    }
+
+    // 把job提交到pool，提交失败时在当前线程执行，保证任务链不会中断
+    // 任务在线程池中被取消或丢弃时调用fail，阶段以对应的异常结束
+    void schedule(ThreadPool* pool, std::function<void()> job, std::function<void(std::exception_ptr)> fail);
+
+    // 一个已调度的阶段结束
+    void finish();
+
+private:
+    ThreadPool cpu_;
+    ThreadPool io_;
+
+    std::mutex pendingMtx_;
+    std::condition_variable pendingCond_;
+    int pending_;   // 已调度尚未执行完的阶段数量，受pendingMtx_保护
+};
+
+
+template<typename T>
+template<typename Func>
+auto Stage<T>::thenCpu(Func&& func) -> Stage<typename StageCall<T, typename std::decay<Func>::type>::type>
+{
+    return then(&executor_->cpu_, std::forward<Func>(func));
+}
+
+
+template<typename T>
+template<typename Func>
+auto Stage<T>::thenIo(Func&& func) -> Stage<typename StageCall<T, typename std::decay<Func>::type>::type>
+{
+    return then(&executor_->io_, std::forward<Func>(func));
+}
+
+
+template<typename T>
+template<typename Func>
+auto Stage<T>::then(ThreadPool* pool, Func&& func) -> Stage<typename StageCall<T, typename std::decay<Func>::type>::type>
+{
+    using FuncType = typename std::decay<Func>::type;
+    using returnType = typename StageCall<T, FuncType>::type;
+    auto next = std::make_shared<StageState<returnType>>();
+    auto prev = state_;
+    auto task = std::make_shared<FuncType>(std::forward<Func>(func));
+    Executor* executor = executor_;
+
+    // 上一阶段完成后才提交，等待期间不占用任何线程
+    prev->then([executor, pool, prev, next, task]() {
+        executor->schedule(pool, [prev, next, task]() {
+            auto call = [&]() { return StageCall<T, FuncType>::call(*task, prev->result); };
+            next->run(call);
+        }, [next](std::exception_ptr e) { next->fail(e); });
+    });
+    return Stage<returnType>(executor_, next);
+}
+
+#endif
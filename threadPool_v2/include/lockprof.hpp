@@ -0,0 +1,211 @@
+#ifndef _LOCKPROF_H
+#define _LOCKPROF_H
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "metrics.hpp"
+
+#define LOCK_SITE_SIZE 4    // LockSite的数量
+
+// 任务队列锁的调用点
+enum class LockSite{
+    SITE_SUBMIT,    // submitTask提交任务
+    SITE_DEQUEUE,   // 工作线程等待和取出任务、线程退出
+    SITE_REAP,      // 控制器扩缩容和回收空闲线程
+    SITE_CONTROL,   // 启动、析构、修改配置、超时补偿等
+};
+
+
+// 一个调用点的锁统计
+struct LockSiteReport
+{
+    const char* site = "";
+    uint64_t acquires = 0;      // 获取锁的次数
+    uint64_t contended = 0;     // 锁已被占用、需要等待的次数
+    Percentiles wait;           // 获取锁的等待时间(ns)，未发生竞争时为0
+    Percentiles hold;           // 持有锁的时间(ns)
+};
+
+
+// 编译时定义THREADPOOL_LOCK_PROFILE才统计锁的竞争情况，否则PoolMutex就是std::mutex
+#ifdef THREADPOOL_LOCK_PROFILE
+
+// 单个线程在一把锁上的统计，只由该线程写入
+struct ThreadLockStats
+{
+    LatencyHistogram wait[LOCK_SITE_SIZE];
+    LatencyHistogram hold[LOCK_SITE_SIZE];
+    std::atomic<uint64_t> contended[LOCK_SITE_SIZE] = {};
+};
+
+
+// 统计等待时间、持有时间和竞争次数的互斥锁，满足Lockable要求，需要配合condition_variable_any使用
+// 调用点通过at()在加锁前设置，条件变量等待后重新加锁时沿用同一个调用点
+class ProfiledMutex
+{
+public:
+    ProfiledMutex() : id_(nextId()) {}
+    ~ProfiledMutex() = default;
+
+    ProfiledMutex(const ProfiledMutex&) = delete;
+    ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+    // 设置当前线程接下来加锁的调用点
+    ProfiledMutex& at(LockSite site)
+    {
+        currSite() = site;
+        return *this;
+    }
+
+    void lock()
+    {
+        int site = static_cast<int>(currSite());
+        ThreadLockStats& stats = localStats();
+        uint64_t wait = 0;
+        if (!mtx_.try_lock())
+        {
+            int64_t begin = nowNs();
+            mtx_.lock();
+            wait = nowNs() - begin;
+            auto& contended = stats.contended[site];
+            contended.store(contended.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        stats.wait[site].record(wait);
+        acquired(stats, site);
+    }
+
+    bool try_lock()
+    {
+        if (!mtx_.try_lock())
+        {
+            return false;
+        }
+        int site = static_cast<int>(currSite());
+        ThreadLockStats& stats = localStats();
+        stats.wait[site].record(0);
+        acquired(stats, site);
+        return true;
+    }
+
+    void unlock()
+    {
+        ThreadLockStats* stats = holder_;
+        int site = holdSite_;
+        uint64_t hold = nowNs() - holdBegin_;
+        // 统计属于本互斥锁，释放后线程池可能立即析构，必须在释放前记录
+        stats->hold[site].record(hold);
+        mtx_.unlock();
+    }
+
+    // 合并所有线程的统计，按调用点返回
+    std::vector<LockSiteReport> report() const
+    {
+        static const char* names[LOCK_SITE_SIZE] = {"submit", "dequeue", "reap", "control"};
+        std::vector<std::shared_ptr<ThreadLockStats>> all;
+        {
+            std::lock_guard<std::mutex> guard(statsMtx_);
+            all = stats_;
+        }
+
+        std::vector<LockSiteReport> res;
+        for (int site = 0; site < LOCK_SITE_SIZE; site++)
+        {
+            LatencyHistogram wait, hold;
+            LockSiteReport item;
+            item.site = names[site];
+            for (auto& stats : all)
+            {
+                wait.merge(stats->wait[site]);
+                hold.merge(stats->hold[site]);
+                item.contended += stats->contended[site].load(std::memory_order_relaxed);
+            }
+            item.wait = wait.percentiles();
+            item.hold = hold.percentiles();
+            item.acquires = item.wait.count;
+            res.push_back(item);
+        }
+        return res;
+    }
+
+private:
+    static int64_t nowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static uint64_t nextId()
+    {
+        static std::atomic<uint64_t> generateId(1);
+        return generateId++;
+    }
+
+    static LockSite& currSite()
+    {
+        thread_local LockSite site = LockSite::SITE_CONTROL;
+        return site;
+    }
+
+    // 持有锁后记录持有者，unlock时计算持有时间
+    void acquired(ThreadLockStats& stats, int site)
+    {
+        holder_ = &stats;
+        holdSite_ = site;
+        holdBegin_ = nowNs();
+    }
+
+    // 当前线程在这把锁上的统计，第一次加锁时创建并登记，锁析构时一起释放
+    // 用全局递增的id而不是地址查找，锁析构后地址被复用也不会拿到旧的统计
+    ThreadLockStats& localStats()
+    {
+        thread_local uint64_t cacheId = 0;
+        thread_local ThreadLockStats* cache = nullptr;
+        thread_local std::unordered_map<uint64_t, ThreadLockStats*> table;
+        if (cacheId != id_)
+        {
+            auto it = table.find(id_);
+            if (it == table.end())
+            {
+                auto stats = std::make_shared<ThreadLockStats>();
+                {
+                    std::lock_guard<std::mutex> guard(statsMtx_);
+                    stats_.push_back(stats);
+                }
+                it = table.emplace(id_, stats.get()).first;
+            }
+            cacheId = id_;
+            cache = it->second;
+        }
+        return *cache;
+    }
+
+private:
+    std::mutex mtx_;
+    uint64_t id_;
+    ThreadLockStats* holder_ = nullptr; // 以下三项只由持有锁的线程读写
+    int holdSite_ = 0;
+    int64_t holdBegin_ = 0;
+
+    mutable std::mutex statsMtx_;   // 保护stats_，只在线程第一次加锁和生成报告时使用
+    std::vector<std::shared_ptr<ThreadLockStats>> stats_;
+};
+
+using PoolMutex = ProfiledMutex;
+using PoolCondition = std::condition_variable_any;
+#define POOL_LOCK_AT(mutex, site) (mutex).at(site)
+
+#else
+
+using PoolMutex = std::mutex;
+using PoolCondition = std::condition_variable;
+#define POOL_LOCK_AT(mutex, site) (mutex)
+
+#endif
+
+#endif
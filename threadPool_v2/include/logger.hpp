@@ -0,0 +1,120 @@
+#ifndef _LOGGER_H
+#define _LOGGER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define LOG_RING_SIZE 256           // 每个线程缓冲的日志条数，必须是2的幂，写满后丢弃新日志
+#define LOG_MESSAGE_SIZE 128        // 单条日志的最大长度，超出部分截断
+#define LOG_FLUSH_INTERVAL_MS 50    // 后台线程输出日志的周期
+#define LOG_RATE_LIMIT 10           // 同一条日志每秒最多输出的次数，超出的只统计数量
+
+// 写日志，fmt必须是字符串字面量，同一个fmt的日志按LOG_RATE_LIMIT限速
+#define POOL_LOG(level, fmt, ...) Logger::instance().log((level), fmt, ##__VA_ARGS__)
+
+enum class LogLevel{
+    LEVEL_INFO,     // 输出到stdout
+    LEVEL_WARN,     // 输出到stderr
+    LEVEL_ERROR,    // 输出到stderr
+};
+
+
+// 一条日志
+struct LogRecord
+{
+    LogLevel level;
+    const char* key;    // 格式字符串地址，用于限速
+    int64_t ts;         // steady_clock时间戳(ns)，合并各线程日志时排序
+    char text[LOG_MESSAGE_SIZE];
+};
+
+
+// 单个线程的日志环形缓冲区，所属线程写入，后台线程读取，不需要加锁
+class LogRing
+{
+public:
+    LogRing() : records_(LOG_RING_SIZE), head_(0), tail_(0), dropped_(0) {}
+    ~LogRing() = default;
+
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+
+    // 取得下一个可写位置，缓冲区满时返回nullptr并计入丢弃数量
+    LogRecord* reserve();
+    // 提交reserve得到的记录
+    void commit();
+    // 取出所有已提交的记录，只能由后台线程调用
+    void drain(std::vector<LogRecord>& out);
+
+    bool empty() const;
+    uint64_t takeDropped();
+
+private:
+    std::vector<LogRecord> records_;
+    std::atomic<uint64_t> head_;    // 下一个写入位置，只由所属线程修改
+    std::atomic<uint64_t> tail_;    // 下一个读取位置，只由后台线程修改
+    std::atomic<uint64_t> dropped_; // 缓冲区满时丢弃的日志数量
+};
+
+
+// 异步日志，写日志只格式化到当前线程的环形缓冲区，由后台线程合并输出到stdout/stderr
+// 调用线程不会因为终端或管道输出慢而阻塞，也不会和其他写日志的线程竞争锁
+// 日志对象创建后不析构，分离的线程在进程退出过程中写日志也不会访问已销毁的对象，退出时由atexit输出剩余日志
+class Logger
+{
+public:
+    static Logger& instance();
+
+    ~Logger() = delete;
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    // 格式化一条日志，参数与printf相同
+    void log(LogLevel level, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+
+    // 立即输出所有缓冲的日志
+    void flush();
+
+private:
+    Logger();
+
+    // 后台线程函数
+    void flushFunc();
+
+    // 进程退出时输出剩余的日志和所有被限速的数量
+    static void finalFlush();
+
+    // 取出所有线程的日志，限速后输出，调用时需要持有flushMtx_
+    // final为true时，同时输出所有未结束窗口中被限速的数量
+    void drainAll(bool final);
+
+    // 同一个格式字符串在一秒内的输出情况，只由持有flushMtx_的线程访问
+    struct RateState
+    {
+        int64_t windowStart = 0;    // 当前一秒窗口的开始时间(ns)
+        int count = 0;              // 窗口内已输出的数量
+        uint64_t suppressed = 0;    // 窗口内被限速丢弃的数量
+        LogLevel level = LogLevel::LEVEL_INFO;
+    };
+
+private:
+    std::mutex registryMtx_;    // 保护rings_，只在线程第一次写日志和后台线程输出时使用
+    std::vector<std::shared_ptr<LogRing>> rings_;
+
+    std::mutex flushMtx_;       // 保证同一时间只有一个线程在输出日志
+    std::unordered_map<const char*, RateState> rates_;
+    std::vector<LogRecord> batch_;
+
+    std::condition_variable flushCond_;
+    std::thread flusher_;       // 后台线程，随进程结束
+};
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+
+#define HISTOGRAM_SUB_BITS 3    // 每个2的幂区间再细分为2^3个桶，相对误差约12%
+#define HISTOGRAM_SUB_SIZE (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKET_SIZE ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_SIZE)
+
+
+// 分位数统计结果
+struct Percentiles
+{
+    uint64_t count = 0;
+    uint64_t p50 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+    uint64_t max = 0;
+};
+
+
+// 对数线性直方图，按2的幂分段，每段再线性细分
+// 只允许一个线程写入（每个工作线程一个），读取时可以和写入并发，不需要加锁
+class LatencyHistogram
+{
+public:
+    LatencyHistogram()
+    {
+        for (auto& count : counts_)
+        {
+            count.store(0, std::memory_order_relaxed);
+        }
+        max_.store(0, std::memory_order_relaxed);
+    }
+    ~LatencyHistogram() = default;
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    // 记录一个值，只能由拥有该直方图的线程调用
+    void record(uint64_t value)
+    {
+        auto& count = counts_[bucketIndex(value)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (value > max_.load(std::memory_order_relaxed))
+        {
+            max_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    // 把other的计数累加到当前直方图，调用者需要保证没有其他线程同时写入当前直方图
+    void merge(const LatencyHistogram& other)
+    {
+        for (int i = 0; i < HISTOGRAM_BUCKET_SIZE; i++)
+        {
+            uint64_t add = other.counts_[i].load(std::memory_order_relaxed);
+            if (add > 0)
+            {
+                counts_[i].store(counts_[i].load(std::memory_order_relaxed) + add, std::memory_order_relaxed);
+            }
+        }
+        uint64_t otherMax = other.max_.load(std::memory_order_relaxed);
+        if (otherMax > max_.load(std::memory_order_relaxed))
+        {
+            max_.store(otherMax, std::memory_order_relaxed);
+        }
+    }
+
+    // 计算分位数，返回所在桶的中间值
+    Percentiles percentiles() const
+    {
+        Percentiles res;
+        for (auto& count : counts_)
+        {
+            res.count += count.load(std::memory_order_relaxed);
+        }
+        res.max = max_.load(std::memory_order_relaxed);
+        if (res.count == 0)
+        {
+            return res;
+        }
+
+        uint64_t rank50 = (res.count * 500 + 999) / 1000;
+        uint64_t rank99 = (res.count * 990 + 999) / 1000;
+        uint64_t rank999 = (res.count * 999 + 999) / 1000;
+        uint64_t total = 0;
+        for (int i = 0; i < HISTOGRAM_BUCKET_SIZE; i++)
+        {
+            uint64_t count = counts_[i].load(std::memory_order_relaxed);
+            if (count == 0)
+            {
+                continue;
+            }
+            uint64_t prev = total;
+            total += count;
+            uint64_t value = std::min(bucketMiddle(i), res.max);
+            if (prev < rank50 && total >= rank50)
+                res.p50 = value;
+            if (prev < rank99 && total >= rank99)
+                res.p99 = value;
+            if (prev < rank999 && total >= rank999)
+                res.p999 = value;
+        }
+        return res;
+    }
+
+private:
+    static int bucketIndex(uint64_t value)
+    {
+        if (value < HISTOGRAM_SUB_SIZE)
+        {
+            return static_cast<int>(value);
+        }
+        int exp = 63 - __builtin_clzll(value);
+        int sub = static_cast<int>(value >> (exp - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_SIZE - 1);
+        return (exp - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_SIZE + sub;
+    }
+
+    static uint64_t bucketMiddle(int index)
+    {
+        if (index < HISTOGRAM_SUB_SIZE)
+        {
+            return index;
+        }
+        int exp = index / HISTOGRAM_SUB_SIZE + HISTOGRAM_SUB_BITS - 1;
+        uint64_t sub = index % HISTOGRAM_SUB_SIZE;
+        uint64_t width = 1ULL << (exp - HISTOGRAM_SUB_BITS);
+        return (1ULL << exp) + sub * width + width / 2;
+    }
+
+private:
+    std::atomic<uint64_t> counts_[HISTOGRAM_BUCKET_SIZE];
+    std::atomic<uint64_t> max_;
+};
+
+
+// 单个工作线程记录的指标，只由该线程写入
+struct WorkerMetrics
+{
+    LatencyHistogram queueWait;     // 入队到开始执行的时间(ns)
+    LatencyHistogram runTime;       // 执行时间(ns)
+    LatencyHistogram queueDepth;    // 取任务后队列中剩余的任务数量
+
+    void merge(const WorkerMetrics& other)
+    {
+        queueWait.merge(other.queueWait);
+        runTime.merge(other.runTime);
+        queueDepth.merge(other.queueDepth);
+    }
+};
+
+
+// 线程池指标快照
+struct MetricsSnapshot
+{
+    Percentiles queueWait;      // 入队到开始执行的时间(ns)
+    Percentiles runTime;        // 执行时间(ns)
+    Percentiles queueDepth;     // 取任务时的队列深度
+    uint64_t currQueueDepth = 0;    // 当前队列中的任务数量
+    uint64_t completedTasks = 0;    // 已执行完成的任务数量，不含被取消、丢弃的任务
+    uint64_t rejectedTasks = 0;     // 提交失败的任务数量（队列满或过载时拒绝）
+    uint64_t cancelledTasks = 0;    // 在队列中被取消、没有执行的任务数量
+    uint64_t droppedTasks = 0;      // 过载时从队头丢弃的任务数量
+    uint64_t spawnedThreads = 0;    // 创建过的线程数量
+    uint64_t reapedThreads = 0;     // 运行中被回收的线程数量（不含线程池析构）
+    uint64_t deadlineMet = 0;       // 在截止时间前执行完的任务数量
+    uint64_t deadlineMissed = 0;    // 执行完时已超过截止时间的任务数量
+    uint64_t deadlineDropped = 0;   // 取出时已过期被丢弃的任务数量
+};
+
+
+// 一个任务标签累计的资源使用量
+struct LabelUsage
+{
+    std::string label;
+    uint64_t tasks = 0;     // 执行的任务数量
+    uint64_t cpuTime = 0;   // 执行线程的CPU时间之和(ns)
+    uint64_t wallTime = 0;  // 执行的墙上时间之和(ns)，明显大于cpuTime说明任务在阻塞
+
+    void merge(const LabelUsage& other)
+    {
+        tasks += other.tasks;
+        cpuTime += other.cpuTime;
+        wallTime += other.wallTime;
+    }
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef _PROBES_H
+#define _PROBES_H
+
+#include <cstdint>
+
+// USDT静态探针，格式与systemtap的sys/sdt.h相同，bpftrace/perf/systemtap都可以挂载
+// 每个探针只是一条nop指令加上.note.stapsdt段中的描述信息，没有挂载时几乎没有开销
+// 不依赖sys/sdt.h头文件和任何运行时库，定义THREADPOOL_NO_PROBES可以去掉全部探针
+// 探针参数统一转换为int64_t，参数描述固定为-8@操作数
+//
+// 线程池中的探针（provider为threadpool）：
+//   task__enqueue(id, queueDepth)              任务入队
+//   task__reject(queueDepth)                   任务队列已满，提交失败
+//   task__dequeue(id, queueWaitNs, queueDepth) 线程取出任务，fixed模式下没有开启指标和负载控制时queueWaitNs为0
+//   task__start(id, threadId, label)           开始执行任务，label为静态字符串地址
+//   task__finish(id, threadId)                 任务执行结束
+//   thread__spawn(threadId, cached)            线程启动，cached表示cached模式
+//   thread__exit(threadId, reaped)             线程退出，reaped为1表示运行中被回收，0表示线程池析构
+#if !defined(THREADPOOL_NO_PROBES) && defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+
+#define POOL_PROBE_ASM(name, args) \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f-991f, 994f-993f, 3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte 0\n" \
+    ".asciz \"threadpool\"\n" \
+    ".asciz \"" #name "\"\n" \
+    ".asciz \"" args "\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base, 1\n" \
+    ".popsection\n" \
+    ".endif\n"
+
+#define POOL_PROBE_ARG(x) ((int64_t)(x))
+
+#define POOL_PROBE1(name, x1) \
+    __asm__ __volatile__(POOL_PROBE_ASM(name, "-8@%[a1]") \
+        :: [a1] "nor" (POOL_PROBE_ARG(x1)))
+
+#define POOL_PROBE2(name, x1, x2) \
+    __asm__ __volatile__(POOL_PROBE_ASM(name, "-8@%[a1] -8@%[a2]") \
+        :: [a1] "nor" (POOL_PROBE_ARG(x1)), [a2] "nor" (POOL_PROBE_ARG(x2)))
+
+#define POOL_PROBE3(name, x1, x2, x3) \
+    __asm__ __volatile__(POOL_PROBE_ASM(name, "-8@%[a1] -8@%[a2] -8@%[a3]") \
+        :: [a1] "nor" (POOL_PROBE_ARG(x1)), [a2] "nor" (POOL_PROBE_ARG(x2)), [a3] "nor" (POOL_PROBE_ARG(x3)))
+
+#else
+
+#define POOL_PROBE1(name, x1) ((void)0)
+#define POOL_PROBE2(name, x1, x2) ((void)0)
+#define POOL_PROBE3(name, x1, x2, x3) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _STRAND_H
+#define _STRAND_H
+
+#include <deque>
+
+#include "threadpool.hpp"
+
+#define STRAND_BATCH_SIZE 16        // 一次占用工作线程最多连续执行的任务数量
+#define STRAND_BATCH_TIME_US 200    // 一次占用工作线程的时间上限，超过后把剩余任务重新提交到线程池
+
+
+// 串行执行器，提交到同一个Strand的任务按FIFO顺序逐个执行，不同Strand之间在线程池中并行
+// Strand不占用固定线程，有任务时才向线程池提交一个批量执行任务，一次连续执行一小批任务后让出线程
+// 线程池任务队列满、提交失败时，由当前线程直接执行这一批任务
+// Strand析构后已提交的任务仍会执行完，线程池必须比所有Strand的任务活得更久
+class Strand
+{
+public:
+    // label为批量执行任务在线程池中的标签，用于CPU统计和执行轨迹
+    explicit Strand(ThreadPool& pool, const char* label = "strand");
+    ~Strand() = default;
+
+    Strand(const Strand&) = delete;
+    Strand& operator=(const Strand&) = delete;
+
+    // 提交任务，返回值和异常通过future获取
+    template<typename Func, typename... Types>
+    auto submitTask(Func&& func, Types&&... paras) -> std::future<decltype(func(paras...))>
+    {
+        using returnType = decltype(func(paras...));
+        auto bindFunc = std::bind(std::forward<Func>(func), std::forward<Types>(paras)...);
+        auto task = std::make_shared<TaskState<returnType, decltype(bindFunc)>>(std::move(bindFunc));
+        std::future<returnType> res = task->getFuture();
+
+        bool schedule = false;
+        {
+            std::lock_guard<std::mutex> guard(state_->mtx);
+            state_->tasks.emplace_back([task]() { task->run(); });
+            if (!state_->running)
+            {
+                // 当前没有批量执行任务，由本次提交负责调度
+                state_->running = true;
+                schedule = true;
+            }
+        }
+        if (schedule)
+        {
+            State::schedule(state_);
+        }
+        return res;
+    }
+
+    // 等待执行的任务数量
+    size_t pending() const;
+
+private:
+    // 与线程池中的批量执行任务共享的状态
+    struct State
+    {
+        ThreadPool* pool;
+        const char* label;
+        std::mutex mtx;     // 保护tasks和running
+        std::deque<std::function<void()>> tasks;
+        bool running = false;   // 是否有批量执行任务在线程池中排队或执行
+
+        // 向线程池提交批量执行任务，失败时在当前线程执行
+        static void schedule(const std::shared_ptr<State>& state);
+        // 向线程池提交批量执行任务，返回是否提交成功
+        static bool submitDrain(const std::shared_ptr<State>& state);
+        // 执行一批任务，队列空时结束，批次用完时重新提交
+        static void drain(const std::shared_ptr<State>& state);
+    };
+    std::shared_ptr<State> state_;
+};
+
+#endif
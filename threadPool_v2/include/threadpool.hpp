@@ -10,14 +10,38 @@
 #include <functional>
 #include <algorithm>
 #include <unordered_map>
+#include <list>
+#include <deque>
+#include <string>
 #include <thread>
+#include <typeinfo>
 
 #include <future>
 #include <iostream>
 
+#include "cancel.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "probes.hpp"
+#include "lockprof.hpp"
+#include "logger.hpp"
+#include "budget.hpp"
+
 #define TASK_MAX_THRESHOLD 1024
 #define THREAD_MAX_THRESHOLD 50
-#define THREAD_MAX_IDLE_TIME_SECOND 60
+#define THREAD_MAX_IDLE_TIME_SECOND 60   // 空闲线程回收时间的默认值
+#define SCALE_INTERVAL_MS 50        // cached模式扩缩容控制器的采样周期
+#define SCALE_GROW_DELAY_MS 10      // 任务排队时间超过该值，认为线程不足
+#define SCALE_SHRINK_DELAY_MS 1     // 任务排队时间低于该值且有空闲线程，认为线程过剩
+#define SCALE_GROW_SAMPLES 2        // 连续多少个采样周期线程不足才扩容
+#define SCALE_SHRINK_SAMPLES 20     // 连续多少个采样周期线程过剩才缩容
+#define SCALE_HOLD_SAMPLES 10       // 扩容没有提高吞吐量后，暂停扩容的采样周期数
+#define CODEL_TARGET_MS 5           // 按排队时间控制负载时，排队时间的目标值
+#define CODEL_INTERVAL_MS 100       // 排队时间持续超过目标值多久后开始拒绝或丢弃任务
+#define MLFQ_LEVELS 3               // 按执行时间调度时的队列级数：短、中、长
+#define MLFQ_SHORT_US 100           // 历史平均执行时间低于该值为短任务
+#define MLFQ_LONG_US 10000          // 历史平均执行时间高于该值为长任务
+#define MLFQ_AGING_MS 50            // 中、长任务排队超过该时间后不再让短任务先执行
 #define FOR(i, size) for(int i=0; i<size; i++)
 
 enum class PoolMode{
@@ -25,6 +49,103 @@ enum class PoolMode{
     MODE_CACHED,    //动态
 };
 
+// 按排队时间控制负载（CoDel）的方式
+enum class DelayControl{
+    CONTROL_NONE,           // 不控制，只在队列满时拒绝
+    CONTROL_REJECT_NEW,     // 排队时间超标期间，新提交的任务立即失败，不等待队列空余
+    CONTROL_DROP_OLDEST,    // 排队时间超标期间，按CoDel的控制律间隔从队头丢弃任务
+};
+
+
+// 提交任务时的可选参数
+struct TaskOptions
+{
+    CancelToken token;  // 取消令牌，默认不可取消
+    std::chrono::milliseconds timeout{0};   // 执行超时时间，从任务开始执行计时，0表示不限制
+    const char* label = nullptr;    // 任务标签，必须是静态字符串，用于执行轨迹
+    int tenant = 0;     // 租户id，由createTenant返回的句柄设置，0为默认租户
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();  // 截止时间，默认没有
+    bool sheddable = true;  // 排队时间超标时能否从队头丢弃，调度后续任务的内部任务（如Strand的批量执行任务）不能丢弃
+};
+
+
+// 租户配置
+struct TenantConfig
+{
+    int weight = 1;     // 权重，每轮调度最多连续取出weight个任务
+    int capacity = TASK_MAX_THRESHOLD;  // 租户任务队列的最大阈值
+    int maxInflight = 0;    // 同时执行的最大任务数量，<=0表示不限制
+    double rate = 0;    // 每秒最多取出的任务数量，<=0表示不限制
+    int burst = 1;      // 空闲后最多连续取出的任务数量
+};
+
+class TenantHandle;
+class BlockingSection;
+
+
+// 设置任务返回值，void返回值单独重载
+template<typename R, typename Func>
+void invokeTask(std::promise<R>& promise, Func& func, std::atomic_bool& done)
+{
+    R val = func();
+    if (!done.exchange(true))
+    {
+        promise.set_value(std::move(val));
+    }
+}
+
+template<typename Func>
+void invokeTask(std::promise<void>& promise, Func& func, std::atomic_bool& done)
+{
+    func();
+    if (!done.exchange(true))
+    {
+        promise.set_value();
+    }
+}
+
+
+// 任务与等待者共享的完成状态
+// 正常执行和取消都可能结束任务，done_保证future只被设置一次
+template<typename R, typename Func>
+class TaskState
+{
+public:
+    TaskState(Func&& func) : func_(std::move(func)), done_(false) {}
+
+    std::future<R> getFuture()
+    {
+        return promise_.get_future();
+    }
+
+    // 执行任务并设置返回值
+    void run()
+    {
+        try
+        {
+            invokeTask(promise_, func_, done_);
+        }
+        catch (...)
+        {
+            abort(std::current_exception());
+        }
+    }
+
+    // 不执行任务，直接以异常结束等待者
+    void abort(std::exception_ptr e)
+    {
+        if (!done_.exchange(true))
+        {
+            promise_.set_exception(e);
+        }
+    }
+
+private:
+    Func func_;
+    std::promise<R> promise_;
+    std::atomic_bool done_;
+};
+
 
 class Thread
 {
@@ -43,7 +164,7 @@ public:
 
 private:
     taskHandler taskHandler_;
-    static int generateId;
+    static std::atomic_int generateId;  // 多个线程池可能同时创建线程
     int threadId;
 
 };
@@ -69,61 +190,254 @@ public:
     template<typename Func, typename... Types>
     auto submitTask(Func&& func, Types&&... paras) -> std::future<decltype(func(paras...))>
     {
-        using returnType = decltype(func(paras...));
-        auto task = std::make_shared<std::packaged_task<returnType()>>(
-            std::bind(std::forward<Func>(func), std::forward<Types>(paras)...)
-        );
-        std::future<returnType> res = task->get_future();
+        return submitTask(TaskOptions(), std::forward<Func>(func), std::forward<Types>(paras)...);
+    }
+
+    // 提交可取消的任务，令牌被取消后，还在队列中的任务不再执行，future得到TaskCancelled异常
+    template<typename Func, typename... Types>
+    auto submitTask(CancelToken token, Func&& func, Types&&... paras) -> std::future<decltype(func(paras...))>
+    {
+        TaskOptions opts;
+        opts.token = std::move(token);
+        return submitTask(opts, std::forward<Func>(func), std::forward<Types>(paras)...);
+    }
+
+    // 提交有截止时间的任务，同一租户中有截止时间的任务按截止时间先后执行（EDF），先于没有截止时间的任务
+    template<typename Func, typename... Types>
+    auto submitWithDeadline(std::chrono::steady_clock::time_point deadline, Func&& func, Types&&... paras) -> std::future<decltype(func(paras...))>
+    {
+        TaskOptions opts;
+        opts.deadline = deadline;
+        return submitTask(opts, std::forward<Func>(func), std::forward<Types>(paras)...);
+    }
 
-        // 获取锁
-        std::unique_lock<std::mutex> lock(taskQueMtx_);
+    // 按照可选参数提交任务
+    template<typename Func, typename... Types>
+    auto submitTask(const TaskOptions& opts, Func&& func, Types&&... paras) -> std::future<decltype(func(paras...))>
+    {
+        using returnType = decltype(func(paras...));
+        auto bindFunc = std::bind(std::forward<Func>(func), std::forward<Types>(paras)...);
+        auto state = std::make_shared<TaskState<returnType, decltype(bindFunc)>>(std::move(bindFunc));
+        std::future<returnType> res = state->getFuture();
 
-        // 线程通信 等待任务队列有空余
-        if (!notFull_.wait_for(lock, std::chrono::seconds(1), [&](){return taskQue_.size() < taskQueMaxThreshold_;}))
+        // 添加进任务队列，队列满时阻塞1s后提交失败
+        Task task = makeTask(opts, state);
+        if (!pushTask(std::move(task), false))
         {
-            // 阻塞时间超过1s后，队列仍满，任务提交失败
-            std::cerr << "任务队列已满，任务提交失败" << std::endl;
-			auto task = std::make_shared<std::packaged_task<returnType()>>(
-				[]()->returnType { return returnType(); });
-			(*task)();
-			return task->get_future();
+            return rejectedFuture<returnType>();
         }
 
-        // 添加进任务队列
-        taskQue_.emplace([=]() {
-            (*task)();
-        });
-        taskSize_++;
+        // 返回任务的Reslt对象
+        return res;
+    }
+
+    // 创建租户，每个租户有独立的任务队列和容量，一个租户提交过多任务不会占满其他租户的队列
+    // 工作线程按权重在租户之间轮转取任务（deficit round robin），默认租户的权重为1
+    TenantHandle createTenant(const TenantConfig& config);
 
-        // 通知条件变量任务队列不空
-        notEmpty_.notify_all(); 
+    // 限制整个线程池每秒取出的任务数量（令牌桶），rate<=0表示不限制，burst为空闲后最多连续取出的任务数量
+    // 限速的任务留在队列中等待，不占用工作线程，关闭线程池时仍按速率执行完
+    void setRateLimit(double rate, int burst = 1);
 
-        // cached模式，处理比较紧急的场景，根据任务数量和空闲线程数量判断是否需要创建新线程
-        if (poolMode_ == PoolMode::MODE_CACHED && taskSize_ > idleThreadSize_ && currThreadSize_ < threadMaxThreshold_)
+    // 设置key对应资源的最大并发任务数量，threshold<=0表示不限制，运行中也可以修改
+    void setLimit(const std::string& key, int threshold);
+
+    // 提交受并发限制的任务，key相同的任务同时执行的数量不超过setLimit设置的值
+    // 超出限制的任务在key对应的等待队列中等待，不进入任务队列，也不占用工作线程，有任务结束时按FIFO顺序放行
+    template<typename Func, typename... Types>
+    auto submitLimited(const std::string& key, Func&& func, Types&&... paras) -> std::future<decltype(func(paras...))>
+    {
+        return submitLimited(key, TaskOptions(), std::forward<Func>(func), std::forward<Types>(paras)...);
+    }
+
+    template<typename Func, typename... Types>
+    auto submitLimited(const std::string& key, const TaskOptions& opts, Func&& func, Types&&... paras)
+        -> std::future<decltype(func(paras...))>
+    {
+        using returnType = decltype(func(paras...));
+        auto bindFunc = std::bind(std::forward<Func>(func), std::forward<Types>(paras)...);
+        auto state = std::make_shared<TaskState<returnType, decltype(bindFunc)>>(std::move(bindFunc));
+        std::future<returnType> res = state->getFuture();
+
+        // 任务结束、被取消或提交失败时，Task析构，名额随之释放
+        Task task = makeTask(opts, state);
+        task.hold = std::make_shared<LimitSlot>(this, key);
+        if (!acquireLimit(key, task))
         {
-            // 创建线程
-            auto uPtr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-            uPtr->start();   // 要执行线程函数
-            threads_.emplace(uPtr->getId(), std::move(uPtr));    // unique_ptr不允许拷贝构造函数，需要右值引用传递，交换资源
-            idleThreadSize_++;
-            currThreadSize_++;
+            // 名额已满，任务留在等待队列中
+            return res;
+        }
+        if (!pushTask(std::move(task), false))
+        {
+            return rejectedFuture<returnType>();
         }
-
-        // 返回任务的Reslt对象
         return res;
     }
 
+    // 提交不需要future的任务，返回是否进入了任务队列，队列满或被拒绝时返回false，run和abort都不会被调用
+    // 进入队列后，任务执行时调用run；被取消、丢弃或超过截止时间而不执行时调用abort，参数为对应的异常
+    // 设置了timeout时，超时后watchdog线程也会调用abort，此时run仍在执行
+    // 用于在线程池上调度后续任务的组件（如Strand、Executor），它们需要可靠地区分提交失败和任务结果
+    bool post(const TaskOptions& opts, std::function<void()> run, std::function<void(std::exception_ptr)> abort);
+
+    // 当前线程正在执行的任务的取消令牌，任务内部可以轮询它提前结束
+    static const CancelToken& currentToken();
+
+    // 任务在阻塞调用（如同步IO）前进入阻塞区，返回的守卫析构时离开
+    // 阻塞期间线程池多启用一个线程，保证执行计算的线程数量不变，离开后多出的线程执行完当前任务就退出
+    // 线程总数不超过max(threadMaxThreshold_, 2*初始线程数量)，超过时不补偿；不在线程池线程中调用时什么也不做
+    static BlockingSection blockingSection();
+
+    // 任务超时回调，参数为执行任务的线程id和任务已执行的时间，在watchdog线程中调用
+    using TimeoutHandler = std::function<void(int, std::chrono::milliseconds)>;
+
+    // 设置任务超时回调
+    void setTimeoutHandler(TimeoutHandler handler);
+
+    // cached模式下，任务超时后是否创建新线程补偿被卡住的线程
+    void setTimeoutCompensation(bool compensate);
+
+    // 按排队时间控制负载，取出任务时统计排队时间，一个interval内的排队时间都超过target时认为过载
+    // 过载期间按mode拒绝新任务或丢弃队头任务，直到有任务的排队时间低于target或队列清空
+    // 拒绝的任务与队列满时一样返回默认值，计入rejectedTasks，丢弃的任务future得到TaskDropped异常，计入droppedTasks
+    // TaskOptions::sheddable为false的任务不会被丢弃，轮到丢弃时照常执行
+    void setDelayControl(DelayControl mode,
+                         std::chrono::milliseconds target = std::chrono::milliseconds(CODEL_TARGET_MS),
+                         std::chrono::milliseconds interval = std::chrono::milliseconds(CODEL_INTERVAL_MS));
+
+    // 是否丢弃取出时已经超过截止时间的任务，丢弃的任务future得到DeadlineExpired异常，默认关闭
+    // 过载时把线程留给还来得及完成的任务
+    void setDropExpired(bool drop);
+
+    // 设置cached模式下多余线程的最大空闲时间，超过后回收，运行中也可以修改
+    void setThreadIdleTimeout(std::chrono::seconds timeout);
+
+    // 注册到多个线程池共享的线程数量预算，必须在start前调用
+    // 注册后start、resize和cached模式扩容得到的线程数量受许可数量限制，至少一个线程
+    void setBudget(ThreadBudget& budget);
+
     // 开启线程池
     void start(int initThreadSize = std::thread::hardware_concurrency());
 
+    // 开启或关闭指标统计，关闭时不记录排队时间、执行时间和队列深度的直方图
+    // fixed模式下开启后每个任务多读两次steady_clock（出队和执行结束），cached模式扩缩容本来就要读出队时间
+    void setMetricsEnabled(bool enabled);
+
+    // 获取指标快照，合并所有线程的直方图
+    MetricsSnapshot metrics();
+
+    // 开启或关闭按任务标签统计CPU时间，每个任务多两次CLOCK_THREAD_CPUTIME_ID系统调用
+    void setCpuAccountingEnabled(bool enabled);
+
+    // 按任务标签累计的CPU时间和墙上时间，按CPU时间从大到小排列，可以定期轮询计算增量
+    std::vector<LabelUsage> labelUsage();
+
+    // 开启或关闭按执行时间调度（多级反馈队列），默认关闭，关闭时按FIFO顺序执行
+    // 按任务标签（没有标签时按可调用对象的类型）统计历史平均执行时间，分为短、中、长三级，短任务优先执行
+    // 排队超过MLFQ_AGING_MS的中、长任务按入队顺序优先执行，避免饿死；没有历史记录的任务按短任务处理
+    void setRuntimeScheduling(bool enabled);
+
+    // 把任务执行轨迹导出为Chrome trace-event格式的JSON文件，可以用Perfetto打开
+    // 编译时需要定义THREADPOOL_TRACE，否则返回false
+    bool dumpTrace(const std::string& path);
+
+    // 任务队列锁按调用点统计的等待时间、持有时间和竞争次数
+    // 编译时需要定义THREADPOOL_LOCK_PROFILE，否则返回空
+    std::vector<LockSiteReport> lockProfile() const;
+
+    // 以下接口在线程池运行中修改容量，立即生效
+    // 调整线程池的线程数量（cached模式下为最小线程数量），缩容时线程执行完当前任务后退出
+    void resize(int threadSize);
+
+    // 调整任务队列最大阈值
+    void setQueueCapacity(int capacity);
+
+    // 调整cached模式的线程数量最大阈值，不能小于当前的线程数量下限
+    void setMaxThreads(int threshold);
+
     // 禁止外部拷贝构造
     ThreadPool(const ThreadPool&) = delete;
     ThreadPool& operator=(const ThreadPool&) = delete;
 
 private:
+    struct Task;
+
+    // 由任务的完成状态生成队列中的任务
+    template<typename State>
+    Task makeTask(const TaskOptions& opts, const std::shared_ptr<State>& state)
+    {
+        Task task;
+        task.run = [state]() { state->run(); };
+        task.abort = [state](std::exception_ptr e) { state->abort(e); };
+        task.token = opts.token;
+        task.timeout = opts.timeout;
+        task.label = opts.label != nullptr ? opts.label : "task";
+        task.kind = opts.label != nullptr ? opts.label : typeid(State).name();
+        task.deadline = opts.deadline;
+        task.tenant = opts.tenant;
+        task.sheddable = opts.sheddable;
+        task.id = reinterpret_cast<uintptr_t>(state.get());
+        return task;
+    }
+
+    // 提交失败时返回的future，立即就绪，值为默认值
+    template<typename R>
+    static std::future<R> rejectedFuture()
+    {
+        auto task = std::make_shared<std::packaged_task<R()>>([]()->R { return R(); });
+        (*task)();
+        return task->get_future();
+    }
+
+    // 任务入队，队列满时等待1s，仍满则返回false，task保持不变
+    // force为true时不检查队列容量，用于已经被接受、之后才放行的任务
+    bool pushTask(Task&& task, bool force);
+
+    // 占用key的一个并发名额，名额已满时把task移入等待队列并返回false
+    bool acquireLimit(const std::string& key, Task& task);
+
+    // 释放key的一个并发名额，有等待的任务时名额直接转给它
+    void releaseLimit(const std::string& key);
+
+    struct TenantQueue;
+
+    // 取出任务时更新CoDel状态，返回是否丢弃该任务，sheddable为false时只更新状态不丢弃，调用时需要持有taskQueMtx_
+    bool delayControl(std::chrono::steady_clock::time_point now, int64_t sojourn, bool sheddable);
+
+    // 按deficit round robin选择下一个取任务的租户，没有可执行的任务时返回nullptr，调用时需要持有taskQueMtx_
+    // 因限速不能取任务时，wakeTime设为最早可以取任务的时间
+    TenantQueue* pickTenant(std::chrono::steady_clock::time_point& wakeTime);
+
     // 定义线程函数
     void threadFunc(int threadId);
 
+    // watchdog线程函数，检查正在执行的任务是否超时
+    void watchdogFunc();
+
+    // cached模式扩缩容控制器线程函数
+    void scaleFunc();
+
+    // 在锁外创建并启动count个线程
+    void spawnThreads(std::unique_lock<PoolMutex>& lock, int count);
+
+    // 标记空闲时间超时的多余线程退出，返回下一个到期时间点，调用时需要持有taskQueMtx_
+    std::chrono::steady_clock::time_point reapIdleThreads();
+
+    // 线程退出时移除线程状态
+    void removeWorker(int threadId);
+
+    // 向预算申请count个许可，返回得到的数量，没有注册预算时全部满足，调用时需要持有taskQueMtx_
+    int acquireBudget(int count, bool force);
+    // targetThreadSize_减少后归还多出的许可，调用时需要持有taskQueMtx_
+    void releaseBudget();
+    friend class ThreadBudget;
+
+    // 进入阻塞区，返回是否补偿了线程
+    bool enterBlocking();
+    // 离开补偿过线程的阻塞区
+    void leaveBlocking();
+    friend class BlockingSection;
+
 private:
     bool checkRunningState() const;
 
@@ -135,19 +449,245 @@ private:
     std::atomic_int currThreadSize_;    // 当前线程数量
     int threadMaxThreshold_;    // 线程数量阈值
 
-    using Task = std::function<void()>;
-    std::queue<Task> taskQue_;    // 任务队列
-    std::atomic_uint taskSize_;  // 任务数量
-    int taskQueMaxThreshold_;   // 任务队列阈值
-
-    std::mutex taskQueMtx_; // 保证任务队列线程安全
-    std::condition_variable notFull_;   // 表示队列不满
-    std::condition_variable notEmpty_;  // 表示队列不空
+    // 任务队列中的任务
+    struct Task
+    {
+        std::function<void()> run;  // 执行任务并设置返回值
+        std::function<void(std::exception_ptr)> abort;  // 任务不执行时，以异常结束等待者
+        CancelToken token;  // 取消令牌
+        std::chrono::milliseconds timeout;  // 执行超时时间，0表示不限制
+        std::chrono::steady_clock::time_point enqueueTime;  // 入队时间，用于统计排队时间
+        const char* label;  // 任务标签
+        uintptr_t id;   // 任务标识，供USDT探针关联同一个任务的事件
+        std::shared_ptr<void> hold; // 随任务析构释放的资源，如并发限制的名额
+        int tenant = 0;     // 所属租户
+        const char* kind;   // 统计历史执行时间的key，任务标签或可调用对象的类型名
+        int level = 0;      // 按执行时间调度时所在的队列级别
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();  // 截止时间
+        bool sheddable = true;  // 排队时间超标时能否丢弃
+    };
+
+    // 租户内的任务队列，有截止时间的任务在最小堆中按截止时间先执行，其余任务按level分级，级别小的先执行
+    // 中、长任务排队超过MLFQ_AGING_MS后先于短任务执行，但不先于有截止时间的任务，受taskQueMtx_保护
+    // 没有开启按执行时间调度时所有任务都在第0级，等价于FIFO队列
+    struct TaskQueue
+    {
+        std::vector<Task> deadlines;    // 按截止时间排列的最小堆
+        std::deque<Task> levels[MLFQ_LEVELS];
+        size_t count = 0;
+
+        bool empty() const { return count == 0; }
+        size_t size() const { return count; }
+        void push(Task&& task);
+        Task pop();
+        static bool laterDeadline(const Task& a, const Task& b);
+        // 最早入队的任务的入队时间，队列不能为空
+        std::chrono::steady_clock::time_point oldest() const;
+    };
+
+    // 令牌桶，取出一个任务消耗一个令牌，受taskQueMtx_保护
+    struct TokenBucket
+    {
+        double rate = 0;    // 每秒补充的令牌数量，<=0表示不限制
+        double burst = 1;   // 令牌数量上限
+        double tokens = 0;
+        std::chrono::steady_clock::time_point last;    // 上次补充令牌的时间
+
+        void configure(double rate, int burst);
+        // 补充令牌，返回是否有可用的令牌
+        bool ready(std::chrono::steady_clock::time_point now);
+        // 下一个令牌可用的时间，ready返回false后调用
+        std::chrono::steady_clock::time_point readyTime() const;
+        void take();
+    };
+    TokenBucket rateBucket_;    // 整个线程池的限速
+
+    // 租户的任务队列，tenants_[0]为默认租户，容量即任务队列阈值
+    struct TenantQueue
+    {
+        int weight = 1;
+        int capacity = TASK_MAX_THRESHOLD;
+        int maxInflight = 0;
+        TaskQueue tasks;
+        int deficit = 0;    // 本轮剩余可取出的任务数量，受taskQueMtx_保护
+        std::atomic_int inflight{0};    // 已取出尚未执行完的任务数量
+        TokenBucket bucket; // 租户的限速
+    };
+    std::vector<std::unique_ptr<TenantQueue>> tenants_;   // 受taskQueMtx_保护，创建后不删除
+    size_t drrCursor_;  // 当前轮到的租户
+    bool drrFresh_;     // 刚轮到当前租户，还没有发放本轮额度
+    bool rateWaiter_;   // 是否已有空闲线程定时等待限速的任务，其余空闲线程只等待通知
+    std::atomic_uint taskSize_;  // 所有租户的任务数量
+
+    PoolMutex taskQueMtx_; // 保证任务队列线程安全
+    PoolCondition notFull_;   // 表示队列不满
+    PoolCondition notEmpty_;  // 表示队列不空
 
     std::atomic_bool running_;   // 允许状态
 
     std::atomic_int idleThreadSize_;    // 空闲线程的数量
 
+    // cached模式扩缩容控制器，根据任务排队时间和吞吐量调整线程数量
+    int targetThreadSize_;  // 控制器期望的线程数量，受taskQueMtx_保护
+    int blockedThreadSize_; // 在阻塞区中且已补偿的线程数量，线程数量按targetThreadSize_+blockedThreadSize_维持，受taskQueMtx_保护
+
+    // 线程数量预算
+    ThreadBudget* budget_;  // 注册的预算，没有时为nullptr
+    int budgetHeld_;        // 持有的许可数量，与targetThreadSize_保持一致，受taskQueMtx_保护
+    std::atomic_bool budgetShed_;   // 其他线程池许可不足，请求回收空闲线程
+    PoolCondition scaleCond_; // 唤醒控制器，配合taskQueMtx_使用
+    std::thread scaler_;    // 控制器线程
+    std::atomic<uint64_t> completedTaskSize_;   // 已执行完成的任务数量，不含被取消、丢弃的任务
+    int64_t sojournSum_;    // 采样周期内出队任务的排队时间之和(ns)，受taskQueMtx_保护
+    int sojournCount_;  // 采样周期内出队的任务数量，受taskQueMtx_保护
+
+    // cached模式的空闲线程列表，按开始空闲的时间排序，队头最早到期，受taskQueMtx_保护
+    // 由控制器线程等待队头的到期时间统一回收，空闲线程自身不再定时唤醒
+    struct IdleThread
+    {
+        std::chrono::steady_clock::time_point idleTime;  // 开始空闲的时间
+        bool retire;    // 被标记为需要退出
+    };
+    std::list<IdleThread> idleList_;
+    std::chrono::seconds threadIdleTimeout_;  // 多余线程的最大空闲时间，受taskQueMtx_保护
+
+    PoolCondition exitCond_;  // 线程退出，配合taskQueMtx_使用
+
+    // 线程当前执行的带超时任务，watchdog据此检查超时
+    struct WorkerState
+    {
+        bool busy = false;      // 正在执行带超时的任务
+        bool timedOut = false;  // 已经报告过超时
+        std::chrono::steady_clock::time_point startTime;    // 任务开始执行时间
+        std::chrono::steady_clock::time_point deadline;     // 任务超时时间点
+        std::function<void(std::exception_ptr)> abort;      // 超时后结束等待者
+        WorkerMetrics metrics;  // 线程自己记录的指标，无锁写入
+        std::shared_ptr<TraceBuffer> trace; // 任务执行轨迹，定义THREADPOOL_TRACE时才创建
+        std::unordered_map<const char*, LabelUsage> usage;  // 按任务标签累计的资源使用量，受usageMtx保护
+        std::mutex usageMtx;    // 只在线程更新和轮询时竞争
+    };
+    std::unordered_map<int, std::shared_ptr<WorkerState>> workers_; // 线程id到线程状态的映射
+    std::mutex workersMtx_; // 保护workers_
+    std::condition_variable watchdogCond_;  // 有新的超时任务开始执行，或线程池退出
+    std::thread watchdog_;  // watchdog线程
+
+    // 指标统计
+    std::atomic_bool metricsEnabled_;   // 是否记录直方图
+    WorkerMetrics retiredMetrics_;  // 已退出线程的指标，受workersMtx_保护
+    std::atomic<uint64_t> rejectedTaskSize_;    // 提交失败的任务数量
+    std::atomic<uint64_t> cancelledTaskSize_;   // 在队列中被取消的任务数量
+    std::atomic<uint64_t> droppedTaskSize_;     // 过载时丢弃的任务数量
+    std::atomic<uint64_t> spawnedThreadSize_;   // 创建过的线程数量
+    std::atomic<uint64_t> reapedThreadSize_;    // 运行中被回收的线程数量
+
+    std::vector<std::shared_ptr<TraceBuffer>> retiredTraces_;  // 已退出线程的执行轨迹，受workersMtx_保护
+
+    std::atomic_bool cpuAccountingEnabled_;    // 是否按任务标签统计CPU时间
+    std::unordered_map<const char*, LabelUsage> retiredUsage_;  // 已退出线程的资源使用量，受workersMtx_保护
+
+    // 按执行时间调度
+    std::atomic_bool runtimeScheduling_;    // 是否开启
+    std::mutex historyMtx_;     // 保护runtimeHistory_，不和taskQueMtx_嵌套
+    std::unordered_map<const char*, int64_t> runtimeHistory_;   // 每种任务执行时间的指数移动平均(ns)
+
+    // 按key限制并发的任务
+    struct Limiter
+    {
+        int threshold = 0;  // 最大并发数量，<=0表示不限制
+        int inflight = 0;   // 已占用名额的任务数量（在任务队列中或正在执行）
+        std::deque<Task> waiting;   // 等待名额的任务
+    };
+    std::unordered_map<std::string, Limiter> limiters_;
+    std::mutex limitersMtx_;    // 保护limiters_
+
+    // 并发名额，析构时归还
+    struct LimitSlot
+    {
+        LimitSlot(ThreadPool* pool, const std::string& key) : pool(pool), key(key) {}
+        ~LimitSlot() { pool->releaseLimit(key); }
+        ThreadPool* pool;
+        std::string key;
+    };
+
+    TimeoutHandler timeoutHandler_; // 任务超时回调
+    bool timeoutCompensation_;  // 任务超时后是否补偿线程
+
+    // 按排队时间控制负载
+    std::atomic<DelayControl> delayControl_;
+    std::atomic_bool codelDropping_;    // 是否处于过载状态，提交任务时在锁外读取
+    std::chrono::nanoseconds codelTarget_;  // 以下受taskQueMtx_保护
+    std::chrono::nanoseconds codelInterval_;
+    std::chrono::steady_clock::time_point codelFirstAbove_; // 排队时间超标后，预计进入过载状态的时间
+    std::chrono::steady_clock::time_point codelDropNext_;   // 下一次丢弃任务的时间
+    int codelDropCount_;    // 本次过载已丢弃的任务数量
+
+    std::atomic_bool dropExpired_;  // 是否丢弃过期任务
+    std::atomic<uint64_t> deadlineMet_;
+    std::atomic<uint64_t> deadlineMissed_;
+    std::atomic<uint64_t> deadlineDropped_;
+
+};
+
+
+// 租户句柄，通过它提交的任务进入该租户的任务队列，占用该租户的容量
+class TenantHandle
+{
+public:
+    TenantHandle() : pool_(nullptr), id_(0) {}
+
+    int id() const
+    {
+        return id_;
+    }
+
+    template<typename Func, typename... Types>
+    auto submitTask(Func&& func, Types&&... paras) -> std::future<decltype(func(paras...))>
+    {
+        return submitTask(TaskOptions(), std::forward<Func>(func), std::forward<Types>(paras)...);
+    }
+
+    template<typename Func, typename... Types>
+    auto submitTask(const TaskOptions& opts, Func&& func, Types&&... paras) -> std::future<decltype(func(paras...))>
+    {
+        TaskOptions tenantOpts = opts;
+        tenantOpts.tenant = id_;
+        return pool_->submitTask(tenantOpts, std::forward<Func>(func), std::forward<Types>(paras)...);
+    }
+
+private:
+    friend class ThreadPool;
+    TenantHandle(ThreadPool* pool, int id) : pool_(pool), id_(id) {}
+
+    ThreadPool* pool_;
+    int id_;
+};
+
+
+// 阻塞区守卫，由ThreadPool::blockingSection()创建，析构时离开阻塞区
+class BlockingSection
+{
+public:
+    BlockingSection(BlockingSection&& other) noexcept : pool_(other.pool_)
+    {
+        other.pool_ = nullptr;
+    }
+    ~BlockingSection()
+    {
+        if (pool_ != nullptr)
+        {
+            pool_->leaveBlocking();
+        }
+    }
+
+    BlockingSection(const BlockingSection&) = delete;
+    BlockingSection& operator=(const BlockingSection&) = delete;
+    BlockingSection& operator=(BlockingSection&&) = delete;
+
+private:
+    friend class ThreadPool;
+    explicit BlockingSection(ThreadPool* pool) : pool_(pool) {}
+
+    ThreadPool* pool_;  // 补偿了线程的线程池，没有补偿时为nullptr
 };
 
 
@@ -0,0 +1,88 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#define TRACE_BUFFER_SIZE 16384     // 每个线程保留的最近事件数量，必须是2的幂
+#define TRACE_RETIRED_BUFFER_SIZE 64    // 最多保留多少个已退出线程的轨迹
+
+// 编译时定义THREADPOOL_TRACE才记录任务执行轨迹，否则记录语句在编译时被移除
+#ifdef THREADPOOL_TRACE
+#define POOL_TRACE(buffer, label, phase) (buffer)->append((label), (phase))
+#else
+#define POOL_TRACE(buffer, label, phase) ((void)0)
+#endif
+
+
+// 一条轨迹事件，对应Chrome trace-event格式中的B/E事件
+struct TraceEvent
+{
+    const char* label;  // 任务标签，必须是静态字符串
+    int64_t ts;         // steady_clock时间戳(ns)
+    char phase;         // 'B'开始执行，'E'执行结束
+};
+
+
+// 单个线程的轨迹环形缓冲区，只由所属线程写入，写满后覆盖最旧的事件
+// 读取时不加锁，通过前后两次读取写位置丢弃可能被覆盖的事件
+class TraceBuffer
+{
+public:
+    explicit TraceBuffer(int threadId) : threadId_(threadId), events_(TRACE_BUFFER_SIZE), head_(0) {}
+    ~TraceBuffer() = default;
+
+    TraceBuffer(const TraceBuffer&) = delete;
+    TraceBuffer& operator=(const TraceBuffer&) = delete;
+
+    // 追加一条事件，只能由所属线程调用
+    void append(const char* label, char phase)
+    {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        TraceEvent& event = events_[head & (TRACE_BUFFER_SIZE - 1)];
+        event.label = label;
+        event.ts = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        event.phase = phase;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    // 按时间顺序复制缓冲区中的事件
+    std::vector<TraceEvent> snapshot() const
+    {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t begin = head > TRACE_BUFFER_SIZE ? head - TRACE_BUFFER_SIZE : 0;
+        std::vector<TraceEvent> res;
+        res.reserve(head - begin);
+        for (uint64_t i = begin; i < head; i++)
+        {
+            res.push_back(events_[i & (TRACE_BUFFER_SIZE - 1)]);
+        }
+
+        // 复制期间被写线程覆盖的事件不可信，丢弃
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t newHead = head_.load(std::memory_order_relaxed);
+        if (newHead > TRACE_BUFFER_SIZE && newHead - TRACE_BUFFER_SIZE > begin)
+        {
+            uint64_t drop = std::min<uint64_t>(newHead - TRACE_BUFFER_SIZE - begin, res.size());
+            res.erase(res.begin(), res.begin() + drop);
+        }
+        return res;
+    }
+
+    int getThreadId() const
+    {
+        return threadId_;
+    }
+
+private:
+    int threadId_;
+    std::vector<TraceEvent> events_;
+    std::atomic<uint64_t> head_;    // 下一个写入位置，单调递增
+};
+
+#endif
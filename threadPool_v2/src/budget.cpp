@@ -0,0 +1,76 @@
+#include "../include/budget.hpp"
+#include "../include/threadpool.hpp"
+
+
+ThreadBudget::ThreadBudget(int permits) : permits_(std::max(1, permits)), used_(0)
+{
+}
+
+
+ThreadBudget& ThreadBudget::process()
+{
+    static ThreadBudget budget(std::thread::hardware_concurrency());
+    return budget;
+}
+
+
+void ThreadBudget::setPermits(int permits)
+{
+    std::lock_guard<std::mutex> guard(mtx_);
+    permits_ = std::max(1, permits);
+}
+
+
+int ThreadBudget::permits()
+{
+    std::lock_guard<std::mutex> guard(mtx_);
+    return permits_;
+}
+
+
+int ThreadBudget::used()
+{
+    std::lock_guard<std::mutex> guard(mtx_);
+    return used_;
+}
+
+
+void ThreadBudget::attach(ThreadPool* pool)
+{
+    std::lock_guard<std::mutex> guard(mtx_);
+    pools_.push_back(pool);
+}
+
+
+void ThreadBudget::detach(ThreadPool* pool)
+{
+    std::lock_guard<std::mutex> guard(mtx_);
+    pools_.erase(std::remove(pools_.begin(), pools_.end(), pool), pools_.end());
+}
+
+
+int ThreadBudget::acquire(ThreadPool* pool, int count, bool force)
+{
+    std::lock_guard<std::mutex> guard(mtx_);
+    int granted = force ? count : std::max(0, std::min(count, permits_ - used_));
+    used_ += granted;
+    if (granted < count)
+    {
+        // 许可不足，其他线程池的控制器在下一个采样周期回收空闲线程，归还的许可由之后的申请取得
+        for (ThreadPool* other : pools_)
+        {
+            if (other != pool)
+            {
+                other->budgetShed_ = true;
+            }
+        }
+    }
+    return granted;
+}
+
+
+void ThreadBudget::release(int count)
+{
+    std::lock_guard<std::mutex> guard(mtx_);
+    used_ -= count;
+}
@@ -0,0 +1,60 @@
+#include "../include/executor.hpp"
+#include <sched.h>
+
+
+Executor::Executor(int cpuThreads, int ioMaxThreads) :
+    cpu_(TASK_MAX_THRESHOLD, cpuThreads, PoolMode::MODE_FIXED),
+    io_(TASK_MAX_THRESHOLD, std::max(ioMaxThreads, EXECUTOR_IO_MIN_THREADS), PoolMode::MODE_CACHED),
+    pending_(0)
+{
+    cpu_.start(cpuThreads);
+    io_.start(EXECUTOR_IO_MIN_THREADS);
+}
+
+
+Executor::~Executor()
+{
+    // 后续阶段可能提交到另一个线程池，等任务链全部结束后再析构线程池
+    std::unique_lock<std::mutex> lock(pendingMtx_);
+    pendingCond_.wait(lock, [&]() { return pending_ == 0; });
+}
+
+
+int Executor::effectiveCores()
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        return std::max(1, CPU_COUNT(&set));
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+
+void Executor::schedule(ThreadPool* pool, std::function<void()> job, std::function<void(std::exception_ptr)> fail)
+{
+    {
+        std::lock_guard<std::mutex> guard(pendingMtx_);
+        pending_++;
+    }
+
+    // 执行、提交失败后在当前线程执行、被取消或丢弃，每条结束路径都会释放ticket
+    // 最后一个引用随线程池中的任务或本函数的局部变量析构时，阶段才算结束
+    std::shared_ptr<Executor> ticket(this, [](Executor* executor) { executor->finish(); });
+
+    if (!pool->post(TaskOptions(), [job, ticket]() { job(); }, [fail, ticket](std::exception_ptr e) { fail(e); }))
+    {
+        job();
+    }
+}
+
+
+void Executor::finish()
+{
+    std::lock_guard<std::mutex> guard(pendingMtx_);
+    if (--pending_ == 0)
+    {
+        pendingCond_.notify_all();
+    }
+}
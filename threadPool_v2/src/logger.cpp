@@ -0,0 +1,219 @@
+#include "../include/logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+static int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 当前线程的日志缓冲区，线程退出后由后台线程输出剩余日志并释放
+static thread_local std::shared_ptr<LogRing> localRing;
+
+
+LogRecord* LogRing::reserve()
+{
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= LOG_RING_SIZE)
+    {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    return &records_[head & (LOG_RING_SIZE - 1)];
+}
+
+
+void LogRing::commit()
+{
+    head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+void LogRing::drain(std::vector<LogRecord>& out)
+{
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    uint64_t head = head_.load(std::memory_order_acquire);
+    for (uint64_t i = tail; i < head; i++)
+    {
+        out.push_back(records_[i & (LOG_RING_SIZE - 1)]);
+    }
+    tail_.store(head, std::memory_order_release);
+}
+
+
+bool LogRing::empty() const
+{
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_relaxed);
+}
+
+
+uint64_t LogRing::takeDropped()
+{
+    return dropped_.exchange(0, std::memory_order_relaxed);
+}
+
+
+Logger& Logger::instance()
+{
+    static Logger* logger = []() {
+        Logger* created = new Logger();
+        std::atexit(&Logger::finalFlush);
+        return created;
+    }();
+    return *logger;
+}
+
+
+Logger::Logger()
+{
+    flusher_ = std::thread(&Logger::flushFunc, this);
+    flusher_.detach();
+}
+
+
+void Logger::finalFlush()
+{
+    Logger& logger = instance();
+    std::lock_guard<std::mutex> guard(logger.flushMtx_);
+    logger.drainAll(true);
+}
+
+
+void Logger::log(LogLevel level, const char* fmt, ...)
+{
+    if (localRing == nullptr)
+    {
+        localRing = std::make_shared<LogRing>();
+        std::lock_guard<std::mutex> guard(registryMtx_);
+        rings_.push_back(localRing);
+    }
+
+    LogRecord* record = localRing->reserve();
+    if (record == nullptr)
+    {
+        return;
+    }
+    record->level = level;
+    record->key = fmt;
+    record->ts = nowNs();
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(record->text, LOG_MESSAGE_SIZE, fmt, args);
+    va_end(args);
+    localRing->commit();
+}
+
+
+void Logger::flush()
+{
+    std::lock_guard<std::mutex> guard(flushMtx_);
+    drainAll(false);
+}
+
+
+void Logger::flushFunc()
+{
+    std::unique_lock<std::mutex> lock(flushMtx_);
+    while (true)
+    {
+        flushCond_.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+        drainAll(false);
+    }
+}
+
+
+void Logger::drainAll(bool final)
+{
+    // 取出各线程的日志，释放已退出且没有剩余日志的线程的缓冲区
+    uint64_t dropped = 0;
+    batch_.clear();
+    {
+        std::lock_guard<std::mutex> guard(registryMtx_);
+        for (auto it = rings_.begin(); it != rings_.end();)
+        {
+            (*it)->drain(batch_);
+            dropped += (*it)->takeDropped();
+            if (it->use_count() == 1 && (*it)->empty())
+                it = rings_.erase(it);
+            else
+                ++it;
+        }
+    }
+    std::stable_sort(batch_.begin(), batch_.end(), [](const LogRecord& a, const LogRecord& b) {
+        return a.ts < b.ts;
+    });
+
+    static const char* names[] = {"INFO", "WARN", "ERROR"};
+    std::string out, err;
+    auto emit = [&](LogLevel level, const char* text) {
+        std::string& stream = level == LogLevel::LEVEL_INFO ? out : err;
+        stream += "[";
+        stream += names[static_cast<int>(level)];
+        stream += "] ";
+        stream += text;
+        stream += "\n";
+    };
+
+    int64_t now = nowNs();
+    for (auto& record : batch_)
+    {
+        RateState& rate = rates_[record.key];
+        if (record.ts - rate.windowStart >= 1000000000)
+        {
+            if (rate.suppressed > 0)
+            {
+                std::string text = std::to_string(rate.suppressed) + " similar messages suppressed: " + record.key;
+                emit(rate.level, text.c_str());
+            }
+            rate.windowStart = record.ts;
+            rate.count = 0;
+            rate.suppressed = 0;
+        }
+        rate.level = record.level;
+        if (rate.count < LOG_RATE_LIMIT)
+        {
+            rate.count++;
+            emit(record.level, record.text);
+        }
+        else
+        {
+            rate.suppressed++;
+        }
+    }
+
+    // 窗口已结束但之后没有新日志的，补充输出被限速的数量，退出时输出所有窗口的数量
+    for (auto it = rates_.begin(); it != rates_.end();)
+    {
+        if (!final && now - it->second.windowStart < 1000000000)
+        {
+            ++it;
+            continue;
+        }
+        if (it->second.suppressed > 0)
+        {
+            std::string text = std::to_string(it->second.suppressed) + " similar messages suppressed: " + it->first;
+            emit(it->second.level, text.c_str());
+        }
+        it = rates_.erase(it);
+    }
+    if (dropped > 0)
+    {
+        std::string text = std::to_string(dropped) + " log messages dropped, ring buffer full";
+        emit(LogLevel::LEVEL_WARN, text.c_str());
+    }
+
+    if (!out.empty())
+    {
+        fwrite(out.data(), 1, out.size(), stdout);
+        fflush(stdout);
+    }
+    if (!err.empty())
+    {
+        fwrite(err.data(), 1, err.size(), stderr);
+        fflush(stderr);
+    }
+}
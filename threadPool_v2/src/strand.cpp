@@ -0,0 +1,73 @@
+#include "../include/strand.hpp"
+
+
+Strand::Strand(ThreadPool& pool, const char* label) : state_(std::make_shared<State>())
+{
+    state_->pool = &pool;
+    state_->label = label;
+}
+
+
+size_t Strand::pending() const
+{
+    std::lock_guard<std::mutex> guard(state_->mtx);
+    return state_->tasks.size();
+}
+
+
+void Strand::State::schedule(const std::shared_ptr<State>& state)
+{
+    if (!submitDrain(state))
+    {
+        drain(state);
+    }
+}
+
+
+bool Strand::State::submitDrain(const std::shared_ptr<State>& state)
+{
+    TaskOptions opts;
+    opts.label = state->label;
+    opts.sheddable = false;
+    // 批量执行任务没有执行就结束时，由结束它的线程执行这一批任务，保证running最终被清除
+    return state->pool->post(opts,
+                             [state]() { drain(state); },
+                             [state](std::exception_ptr) { drain(state); });
+}
+
+
+void Strand::State::drain(const std::shared_ptr<State>& state)
+{
+    while (true)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(STRAND_BATCH_TIME_US);
+        for (int i = 0; i < STRAND_BATCH_SIZE; i++)
+        {
+            std::function<void()> task;
+            {
+                std::lock_guard<std::mutex> guard(state->mtx);
+                if (state->tasks.empty())
+                {
+                    // 队列已空，下一次提交重新调度
+                    state->running = false;
+                    return;
+                }
+                task = std::move(state->tasks.front());
+                state->tasks.pop_front();
+            }
+            task();
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                break;
+            }
+        }
+
+        // 批次用完，把剩余任务重新提交到线程池，让其他任务有机会执行
+        // running保持为true，调度权交给新提交的批量执行任务
+        if (submitDrain(state))
+        {
+            return;
+        }
+        // 提交失败，继续在当前线程执行
+    }
+}
@@ -1,126 +1,1366 @@
 #include "../include/threadpool.hpp"
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <time.h>
+
+// 当前线程正在执行的任务的取消令牌
+static thread_local CancelToken currToken;
+
+// 当前线程所属的线程池，不是线程池线程时为nullptr
+static thread_local ThreadPool* currPool = nullptr;
+
+// 当前线程已消耗的CPU时间(ns)
+static int64_t threadCpuNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
 
 
 ThreadPool::ThreadPool(int taskMaxThreshold, int threadMaxThrshold, PoolMode mode) : 
+    poolMode_(mode),
     initThreadSize_(0),
-    taskSize_(0),
     currThreadSize_(0),
-    taskQueMaxThreshold_(taskMaxThreshold),
     threadMaxThreshold_(threadMaxThrshold),
-    poolMode_(mode),
+    drrCursor_(0),
+    drrFresh_(true),
+    rateWaiter_(false),
+    taskSize_(0),
     running_(false),
-    idleThreadSize_(0)
+    idleThreadSize_(0),
+    targetThreadSize_(0),
+    blockedThreadSize_(0),
+    budget_(nullptr),
+    budgetHeld_(0),
+    budgetShed_(false),
+    completedTaskSize_(0),
+    sojournSum_(0),
+    sojournCount_(0),
+    threadIdleTimeout_(THREAD_MAX_IDLE_TIME_SECOND),
+    metricsEnabled_(false),
+    rejectedTaskSize_(0),
+    cancelledTaskSize_(0),
+    droppedTaskSize_(0),
+    spawnedThreadSize_(0),
+    reapedThreadSize_(0),
+    cpuAccountingEnabled_(false),
+    runtimeScheduling_(false),
+    timeoutCompensation_(false),
+    delayControl_(DelayControl::CONTROL_NONE),
+    codelDropping_(false),
+    codelTarget_(std::chrono::milliseconds(CODEL_TARGET_MS)),
+    codelInterval_(std::chrono::milliseconds(CODEL_INTERVAL_MS)),
+    codelDropCount_(0),
+    dropExpired_(false),
+    deadlineMet_(0),
+    deadlineMissed_(0),
+    deadlineDropped_(0)
 {
+    // 保证日志对象先于线程池构造，退出时的atexit输出排在线程池析构之后
+    Logger::instance();
 
+    // 默认租户，submitTask不指定租户时使用，容量即任务队列阈值
+    tenants_.push_back(std::make_unique<TenantQueue>());
+    tenants_[0]->capacity = taskMaxThreshold;
 }
 
 
 ThreadPool::~ThreadPool(){
     running_ = false;
+
+    // 通知并回收控制器线程
+    {
+        std::lock_guard<PoolMutex> guard(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_CONTROL));
+        notEmpty_.notify_all();
+        scaleCond_.notify_all();
+    }
+    if (scaler_.joinable())
+    {
+        scaler_.join();
+    }
+
+    // 通知并回收watchdog线程
+    {
+        std::lock_guard<std::mutex> guard(workersMtx_);
+        watchdogCond_.notify_all();
+    }
+    if (watchdog_.joinable())
+    {
+        watchdog_.join();
+    }
+
+    // 等待线程回收
+    std::unique_lock<PoolMutex> lock(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_CONTROL));
+    exitCond_.wait(lock, [&]() { return currThreadSize_ == 0; });
+
+    if (budget_ != nullptr)
+    {
+        budget_->release(budgetHeld_);
+        budget_->detach(this);
+    }
+    lock.unlock();
+
+    // 没有启动过的线程池中可能还有排队的任务，在成员析构前释放，任务归还并发名额时limiters_还存在
+    // 先取出等待名额的任务，归还名额时不会再把它们放进任务队列
+    std::vector<Task> waiting;
+    {
+        std::lock_guard<std::mutex> guard(limitersMtx_);
+        for (auto& item : limiters_)
+        {
+            std::move(item.second.waiting.begin(), item.second.waiting.end(), std::back_inserter(waiting));
+            item.second.waiting.clear();
+        }
+    }
+    std::vector<TaskQueue> queued(tenants_.size());
+    {
+        std::lock_guard<PoolMutex> guard(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_CONTROL));
+        FOR(i, static_cast<int>(tenants_.size()))
+        {
+            std::swap(queued[i], tenants_[i]->tasks);
+        }
+        taskSize_ = 0;
+    }
+}
+
+
+const CancelToken& ThreadPool::currentToken()
+{
+    return currToken;
+}
+
+
+BlockingSection ThreadPool::blockingSection()
+{
+    ThreadPool* pool = currPool;
+    return BlockingSection(pool != nullptr && pool->enterBlocking() ? pool : nullptr);
+}
+
+
+bool ThreadPool::enterBlocking()
+{
+    std::unique_lock<PoolMutex> lock(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_CONTROL));
+    if (!running_ || targetThreadSize_ + blockedThreadSize_ >= std::max(threadMaxThreshold_, 2 * initThreadSize_))
+    {
+        return false;
+    }
+    blockedThreadSize_++;
+    if (currThreadSize_ < targetThreadSize_ + blockedThreadSize_)
+    {
+        // 之前补偿的线程还没退出时直接沿用，否则创建一个
+        spawnThreads(lock, 1);
+    }
+    return true;
+}
+
+
+void ThreadPool::leaveBlocking()
+{
+    std::lock_guard<PoolMutex> guard(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_CONTROL));
+    blockedThreadSize_--;
+    // 唤醒空闲线程退出多余的一个，都在忙时由先执行完任务的线程退出
     notEmpty_.notify_all();
-    while (currThreadSize_ > 0);    // 等待线程回收
 }
 
 
 bool ThreadPool::checkRunningState() const
 {
-    return running_;
+    return running_;
+}
+
+
+void ThreadPool::setMode(PoolMode mode)
+{
+    if (checkRunningState())
+        return;
+    poolMode_ = mode;
+}
+
+
+void ThreadPool::setTaskQueMaxThreshold(int threshold)
+{
+    if (checkRunningState())
+        return;
+    tenants_[0]->capacity = threshold;
+}
+
+
+void ThreadPool::setThreadMaxThreshold(int threshold)
+{
+    if (checkRunningState() || poolMode_ == PoolMode::MODE_FIXED)
+        return;
+    threadMaxThreshold_ = threshold;
+}
+
+
+void ThreadPool::setTimeoutHandler(TimeoutHandler handler)
+{
+    if (checkRunningState())
+        return;
+    timeoutHandler_ = std::move(handler);
+}
+
+
+void ThreadPool::setTimeoutCompensation(bool compensate)
+{
+    if (checkRunningState())
+        return;
+    timeoutCompensation_ = compensate;
+}
+
+
+void ThreadPool::setDelayControl(DelayControl mode, std::chrono::milliseconds target, std::chrono::milliseconds interval)
+{
+    std::lock_guard<PoolMutex> guard(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_CONTROL));
+    delayControl_ = mode;
+    codelTarget_ = target;
+    codelInterval_ = interval;
+    codelFirstAbove_ = std::chrono::steady_clock::time_point();
+    codelDropping_ = false;
+}
+
+
+bool ThreadPool::delayControl(std::chrono::steady_clock::time_point now, int64_t sojourn, bool sheddable)
+{
+    // 只要有一个任务的排队时间低于target，说明一个interval内的最小排队时间没有超标，退出过载状态
+    if (std::chrono::nanoseconds(sojourn) < codelTarget_)
+    {
+        codelFirstAbove_ = std::chrono::steady_clock::time_point();
+        codelDropping_ = false;
+        return false;
+    }
+    if (codelFirstAbove_ == std::chrono::steady_clock::time_point())
+    {
+        codelFirstAbove_ = now + codelInterval_;
+        return false;
+    }
+    if (!codelDropping_)
+    {
+        if (now < codelFirstAbove_)
+        {
+            return false;
+        }
+        codelDropping_ = true;
+        codelDropCount_ = 0;
+        codelDropNext_ = now;
+    }
+    if (delayControl_ != DelayControl::CONTROL_DROP_OLDEST || now < codelDropNext_ || !sheddable)
+    {
+        return false;
+    }
+
+    // CoDel控制律：丢弃间隔为interval/sqrt(count)，持续过载时丢弃得越来越快
+    codelDropCount_++;
+    codelDropNext_ = now + std::chrono::duration_cast<std::chrono::nanoseconds>(codelInterval_ / std::sqrt(codelDropCount_));
+    return true;
+}
+
+
+void ThreadPool::setDropExpired(bool drop)
+{
+    dropExpired_ = drop;
+}
+
+
+void ThreadPool::setThreadIdleTimeout(std::chrono::seconds timeout)
+{
+    std::lock_guard<PoolMutex> guard(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_CONTROL));
+    threadIdleTimeout_ = timeout;
+    // 到期时间变化，唤醒控制器重新计算
+    scaleCond_.notify_all();
+}
+
+
+void ThreadPool::setMetricsEnabled(bool enabled)
+{
+    metricsEnabled_ = enabled;
+}
+
+
+MetricsSnapshot ThreadPool::metrics()
+{
+    // 直方图较大，放在堆上合并
+    auto total = std::make_unique<WorkerMetrics>();
+    {
+        std::lock_guard<std::mutex> guard(workersMtx_);
+        total->merge(retiredMetrics_);
+        for (auto& item : workers_)
+        {
+            total->merge(item.second->metrics);
+        }
+    }
+
+    MetricsSnapshot snapshot;
+    snapshot.queueWait = total->queueWait.percentiles();
+    snapshot.runTime = total->runTime.percentiles();
+    snapshot.queueDepth = total->queueDepth.percentiles();
+    snapshot.currQueueDepth = taskSize_;
+    snapshot.completedTasks = completedTaskSize_;
+    snapshot.rejectedTasks = rejectedTaskSize_;
+    snapshot.cancelledTasks = cancelledTaskSize_;
+    snapshot.droppedTasks = droppedTaskSize_;
+    snapshot.deadlineMet = deadlineMet_;
+    snapshot.deadlineMissed = deadlineMissed_;
+    snapshot.deadlineDropped = deadlineDropped_;
+    snapshot.spawnedThreads = spawnedThreadSize_;
+    snapshot.reapedThreads = reapedThreadSize_;
+    return snapshot;
+}
+
+
+void ThreadPool::setCpuAccountingEnabled(bool enabled)
+{
+    cpuAccountingEnabled_ = enabled;
+}
+
+
+void ThreadPool::setRuntimeScheduling(bool enabled)
+{
+    runtimeScheduling_ = enabled;
+}
+
+
+bool ThreadPool::TaskQueue::laterDeadline(const Task& a, const Task& b)
+{
+    return a.deadline > b.deadline;
+}
+
+
+void ThreadPool::TaskQueue::push(Task&& task)
+{
+    if (task.deadline != std::chrono::steady_clock::time_point::max())
+    {
+        deadlines.push_back(std::move(task));
+        std::push_heap(deadlines.begin(), deadlines.end(), laterDeadline);
+    }
+    else
+    {
+        levels[task.level].push_back(std::move(task));
+    }
+    count++;
+}
+
+
+ThreadPool::Task ThreadPool::TaskQueue::pop()
+{
+    // 有截止时间的任务按截止时间先执行，过载时也不被没有截止时间的任务插队
+    if (!deadlines.empty())
+    {
+        std::pop_heap(deadlines.begin(), deadlines.end(), laterDeadline);
+        Task task = std::move(deadlines.back());
+        deadlines.pop_back();
+        count--;
+        return task;
+    }
+
+    std::deque<Task>* first = nullptr;  // 级别最小的非空队列
+    std::deque<Task>* oldest = nullptr; // 队头入队最早的队列
+    for (auto& level : levels)
+    {
+        if (level.empty())
+        {
+            continue;
+        }
+        if (first == nullptr)
+        {
+            first = &level;
+        }
+        if (oldest == nullptr || level.front().enqueueTime < oldest->front().enqueueTime)
+        {
+            oldest = &level;
+        }
+    }
+
+    // 其余任务中排队超时的中、长任务先执行，其次是级别最小的任务
+    // 只有一级有任务时就是FIFO顺序，不需要读取时钟
+    std::deque<Task>* from = first;
+    if (oldest != first &&
+        std::chrono::steady_clock::now() - oldest->front().enqueueTime >= std::chrono::milliseconds(MLFQ_AGING_MS))
+    {
+        from = oldest;
+    }
+
+    Task task = std::move(from->front());
+    from->pop_front();
+    count--;
+    return task;
+}
+
+
+std::chrono::steady_clock::time_point ThreadPool::TaskQueue::oldest() const
+{
+    auto time = std::chrono::steady_clock::time_point::max();
+    for (auto& task : deadlines)
+    {
+        time = std::min(time, task.enqueueTime);
+    }
+    for (auto& level : levels)
+    {
+        if (!level.empty())
+        {
+            time = std::min(time, level.front().enqueueTime);
+        }
+    }
+    return time;
+}
+
+
+std::vector<LabelUsage> ThreadPool::labelUsage()
+{
+    // 同一个标签在不同编译单元中可能是不同的地址，按字符串内容合并
+    std::map<std::string, LabelUsage> total;
+    auto add = [&](const std::unordered_map<const char*, LabelUsage>& usage) {
+        for (auto& item : usage)
+        {
+            LabelUsage& entry = total[item.second.label];
+            entry.label = item.second.label;
+            entry.merge(item.second);
+        }
+    };
+    {
+        std::lock_guard<std::mutex> guard(workersMtx_);
+        add(retiredUsage_);
+        for (auto& item : workers_)
+        {
+            std::lock_guard<std::mutex> usageGuard(item.second->usageMtx);
+            add(item.second->usage);
+        }
+    }
+
+    std::vector<LabelUsage> res;
+    for (auto& item : total)
+    {
+        res.push_back(std::move(item.second));
+    }
+    std::sort(res.begin(), res.end(), [](const LabelUsage& a, const LabelUsage& b) {
+        return a.cpuTime > b.cpuTime;
+    });
+    return res;
+}
+
+
+#ifdef THREADPOOL_TRACE
+// 转义JSON字符串
+static std::string escapeJson(const char* str)
+{
+    std::string res;
+    for (; *str != '\0'; str++)
+    {
+        char ch = *str;
+        if (ch == '"' || ch == '\\')
+        {
+            res += '\\';
+            res += ch;
+        }
+        else if (static_cast<unsigned char>(ch) < 0x20)
+        {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", ch);
+            res += buf;
+        }
+        else
+        {
+            res += ch;
+        }
+    }
+    return res;
+}
+#endif
+
+
+bool ThreadPool::dumpTrace(const std::string& path)
+{
+#ifdef THREADPOOL_TRACE
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> guard(workersMtx_);
+        buffers = retiredTraces_;
+        for (auto& item : workers_)
+        {
+            if (item.second->trace != nullptr)
+            {
+                buffers.push_back(item.second->trace);
+            }
+        }
+    }
+
+    std::ofstream out(path);
+    if (!out)
+    {
+        return false;
+    }
+
+    // 时间戳以微秒为单位，Chrome trace-event格式要求
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    for (auto& buffer : buffers)
+    {
+        int tid = buffer->getThreadId();
+        out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+            << ",\"args\":{\"name\":\"worker " << tid << "\"}}";
+        first = false;
+
+        bool started = false;
+        for (auto& event : buffer->snapshot())
+        {
+            // 环形缓冲区覆盖后，开头可能是没有对应开始事件的结束事件
+            if (!started && event.phase == 'E')
+            {
+                continue;
+            }
+            started = true;
+            char ts[32];
+            snprintf(ts, sizeof(ts), "%.3f", event.ts / 1000.0);
+            out << ",\n{\"name\":\"" << escapeJson(event.label) << "\",\"ph\":\"" << event.phase
+                << "\",\"ts\":" << ts << ",\"pid\":1,\"tid\":" << tid << "}";
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+
+std::vector<LockSiteReport> ThreadPool::lockProfile() const
+{
+#ifdef THREADPOOL_LOCK_PROFILE
+    return taskQueMtx_.report();
+#else
+    return {};
+#endif
+}
+
+
+bool ThreadPool::pushTask(Task&& task, bool force)
+{
+    if (!force && codelDropping_.load(std::memory_order_relaxed) &&
+        delayControl_.load(std::memory_order_relaxed) == DelayControl::CONTROL_REJECT_NEW)
+    {
+        // 排队时间持续超标，立即拒绝，不进入队列等待
+        rejectedTaskSize_.fetch_add(1, std::memory_order_relaxed);
+        POOL_PROBE1(task__reject, taskSize_.load());
+        POOL_LOG(LogLevel::LEVEL_WARN, "任务排队时间过长，任务提交失败");
+        return false;
+    }
+
+    if (runtimeScheduling_.load(std::memory_order_relaxed))
+    {
+        // 按历史平均执行时间分级，在获取任务队列锁之前查询
+        std::lock_guard<std::mutex> guard(historyMtx_);
+        auto it = runtimeHistory_.find(task.kind);
+        if (it != runtimeHistory_.end())
+        {
+            task.level = it->second < MLFQ_SHORT_US * 1000LL ? 0 : it->second < MLFQ_LONG_US * 1000LL ? 1 : 2;
+        }
+    }
+
+    // 获取锁
+    std::unique_lock<PoolMutex> lock(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_SUBMIT));
+
+    // 每个租户有独立的任务队列，只等待所属租户的队列有空余
+    if (task.tenant < 0 || task.tenant >= static_cast<int>(tenants_.size()))
+    {
+        task.tenant = 0;
+    }
+    TenantQueue& tenant = *tenants_[task.tenant];
+
+    // 线程通信 等待任务队列有空余
+    if (!force && !notFull_.wait_for(lock, std::chrono::seconds(1), [&](){return tenant.tasks.size() < static_cast<size_t>(tenant.capacity);}))
+    {
+        // 阻塞时间超过1s后，队列仍满，任务提交失败
+        rejectedTaskSize_.fetch_add(1, std::memory_order_relaxed);
+        POOL_PROBE1(task__reject, taskSize_.load());
+        lock.unlock();
+        POOL_LOG(LogLevel::LEVEL_WARN, "任务队列已满，任务提交失败");
+        return false;
+    }
+
+    // 添加进任务队列
+    task.enqueueTime = std::chrono::steady_clock::now();
+    uintptr_t id = task.id;
+    tenant.tasks.push(std::move(task));
+    taskSize_++;
+    POOL_PROBE2(task__enqueue, id, taskSize_.load());
+
+    // 通知条件变量任务队列不空
+    notEmpty_.notify_all();
+
+    // cached模式下，任务数量超过空闲线程数量时，唤醒扩缩容控制器立即开始采样
+    // 线程由控制器线程创建，不在提交任务的路径上创建
+    if (poolMode_ == PoolMode::MODE_CACHED && static_cast<int>(taskSize_) > idleThreadSize_)
+    {
+        scaleCond_.notify_one();
+    }
+    return true;
+}
+
+
+bool ThreadPool::post(const TaskOptions& opts, std::function<void()> run, std::function<void(std::exception_ptr)> abort)
+{
+    static std::atomic<uintptr_t> generatePostId(1);
+
+    Task task;
+    task.run = std::move(run);
+    task.abort = std::move(abort);
+    task.token = opts.token;
+    task.timeout = opts.timeout;
+    task.label = opts.label != nullptr ? opts.label : "task";
+    task.kind = task.label;
+    task.deadline = opts.deadline;
+    task.tenant = opts.tenant;
+    task.sheddable = opts.sheddable;
+    task.id = generatePostId++;
+    return pushTask(std::move(task), false);
+}
+
+
+TenantHandle ThreadPool::createTenant(const TenantConfig& config)
+{
+    auto tenant = std::make_unique<TenantQueue>();
+    tenant->weight = std::max(1, config.weight);
+    tenant->capacity = std::max(1, config.capacity);
+    tenant->maxInflight = config.maxInflight;
+    tenant->bucket.configure(config.rate, config.burst);
+
+    std::lock_guard<PoolMutex> guard(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_CONTROL));
+    tenants_.push_back(std::move(tenant));
+    return TenantHandle(this, static_cast<int>(tenants_.size()) - 1);
+}
+
+
+void ThreadPool::setRateLimit(double rate, int burst)
+{
+    std::lock_guard<PoolMutex> guard(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_CONTROL));
+    rateBucket_.configure(rate, burst);
+    // 放宽限速后，等待令牌的任务可能可以立即执行
+    notEmpty_.notify_all();
+}
+
+
+void ThreadPool::TokenBucket::configure(double rate, int burst)
+{
+    this->rate = rate;
+    this->burst = std::max(1, burst);
+    tokens = this->burst;
+    last = std::chrono::steady_clock::now();
+}
+
+
+bool ThreadPool::TokenBucket::ready(std::chrono::steady_clock::time_point now)
+{
+    if (rate <= 0)
+    {
+        return true;
+    }
+    if (tokens < burst)
+    {
+        tokens = std::min(burst, tokens + std::chrono::duration<double>(now - last).count() * rate);
+    }
+    last = now;
+    return tokens >= 1;
+}
+
+
+std::chrono::steady_clock::time_point ThreadPool::TokenBucket::readyTime() const
+{
+    auto wait = std::chrono::duration<double>((1 - tokens) / rate);
+    return last + std::chrono::duration_cast<std::chrono::steady_clock::duration>(wait) + std::chrono::microseconds(1);
+}
+
+
+void ThreadPool::TokenBucket::take()
+{
+    if (rate > 0)
+    {
+        tokens -= 1;
+    }
+}
+
+
+ThreadPool::TenantQueue* ThreadPool::pickTenant(std::chrono::steady_clock::time_point& wakeTime)
+{
+    wakeTime = std::chrono::steady_clock::time_point::max();
+    if (taskSize_ == 0)
+    {
+        return nullptr;
+    }
+
+    // 没有限速时不读取时钟
+    std::chrono::steady_clock::time_point now;
+    auto throttled = [&](TokenBucket& bucket) {
+        if (bucket.rate <= 0)
+        {
+            return false;
+        }
+        if (now == std::chrono::steady_clock::time_point())
+        {
+            now = std::chrono::steady_clock::now();
+        }
+        if (bucket.ready(now))
+        {
+            return false;
+        }
+        wakeTime = std::min(wakeTime, bucket.readyTime());
+        return true;
+    };
+    if (throttled(rateBucket_))
+    {
+        return nullptr;
+    }
+
+    // 每个租户轮到时发放weight个额度，额度用完或没有可执行的任务时轮到下一个租户
+    // 因执行数量达到maxInflight或限速而跳过的租户保留剩余额度，队列为空的租户清空额度
+    size_t size = tenants_.size();
+    for (size_t step = 0; step < 2 * size; step++)
+    {
+        TenantQueue& tenant = *tenants_[drrCursor_];
+        if (tenant.tasks.empty())
+        {
+            tenant.deficit = 0;
+        }
+        else if ((tenant.maxInflight <= 0 || tenant.inflight < tenant.maxInflight) && !throttled(tenant.bucket))
+        {
+            if (drrFresh_)
+            {
+                tenant.deficit += tenant.weight;
+                drrFresh_ = false;
+            }
+            if (tenant.deficit > 0)
+            {
+                return &tenant;
+            }
+        }
+        drrCursor_ = (drrCursor_ + 1) % size;
+        drrFresh_ = true;
+    }
+    return nullptr;
+}
+
+
+void ThreadPool::setLimit(const std::string& key, int threshold)
+{
+    // 提高限制后，放行等待的任务
+    std::vector<Task> release;
+    {
+        std::lock_guard<std::mutex> guard(limitersMtx_);
+        Limiter& limiter = limiters_[key];
+        limiter.threshold = threshold;
+        while (!limiter.waiting.empty() && (threshold <= 0 || limiter.inflight < threshold))
+        {
+            release.push_back(std::move(limiter.waiting.front()));
+            limiter.waiting.pop_front();
+            limiter.inflight++;
+        }
+    }
+    for (auto& task : release)
+    {
+        pushTask(std::move(task), true);
+    }
+}
+
+
+bool ThreadPool::acquireLimit(const std::string& key, Task& task)
+{
+    std::lock_guard<std::mutex> guard(limitersMtx_);
+    Limiter& limiter = limiters_[key];
+    if (limiter.threshold > 0 && limiter.inflight >= limiter.threshold)
+    {
+        limiter.waiting.push_back(std::move(task));
+        return false;
+    }
+    limiter.inflight++;
+    return true;
+}
+
+
+void ThreadPool::releaseLimit(const std::string& key)
+{
+    Task next;
+    {
+        std::lock_guard<std::mutex> guard(limitersMtx_);
+        Limiter& limiter = limiters_[key];
+        if (limiter.waiting.empty() || (limiter.threshold > 0 && limiter.inflight > limiter.threshold))
+        {
+            limiter.inflight--;
+            return;
+        }
+
+        // 名额直接转给下一个等待的任务
+        next = std::move(limiter.waiting.front());
+        limiter.waiting.pop_front();
+    }
+
+    // 等待的任务在提交时已被接受，不再因队列满而失败
+    pushTask(std::move(next), true);
+}
+
+
+void ThreadPool::resize(int threadSize)
+{
+    std::unique_lock<PoolMutex> lock(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_CONTROL));
+    if (!checkRunningState() || threadSize <= 0)
+        return;
+    if (poolMode_ == PoolMode::MODE_CACHED)
+    {
+        threadSize = std::min(threadSize, threadMaxThreshold_);
+    }
+
+    if (threadSize > targetThreadSize_)
+    {
+        threadSize = targetThreadSize_ + acquireBudget(threadSize - targetThreadSize_, false);
+    }
+
+    initThreadSize_ = threadSize;
+    targetThreadSize_ = threadSize;
+    releaseBudget();
+    if (currThreadSize_ < threadSize)
+    {
+        // 扩容，直接在调用线程中创建，尽快吸收突发任务
+        spawnThreads(lock, threadSize - currThreadSize_);
+    }
+    else
+    {
+        // 缩容，唤醒空闲线程退出，忙碌的线程执行完当前任务后退出
+        notEmpty_.notify_all();
+    }
+}
+
+
+void ThreadPool::setQueueCapacity(int capacity)
+{
+    std::lock_guard<PoolMutex> guard(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_CONTROL));
+    if (capacity <= 0)
+        return;
+    tenants_[0]->capacity = capacity;
+    // 容量变大，唤醒等待队列空余的提交者；变小时已入队的任务保留，新任务等待队列降到容量以下
+    notFull_.notify_all();
+}
+
+
+void ThreadPool::setMaxThreads(int threshold)
+{
+    std::lock_guard<PoolMutex> guard(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_CONTROL));
+    if (poolMode_ == PoolMode::MODE_FIXED || threshold < initThreadSize_)
+        return;
+    threadMaxThreshold_ = threshold;
+    if (targetThreadSize_ > threshold)
+    {
+        // 超过新阈值的线程执行完当前任务后退出
+        targetThreadSize_ = threshold;
+        releaseBudget();
+        notEmpty_.notify_all();
+    }
 }
 
 
-void ThreadPool::setMode(PoolMode mode)
+void ThreadPool::setBudget(ThreadBudget& budget)
 {
-    if (checkRunningState())
+    if (checkRunningState() || budget_ != nullptr)
         return;
-    poolMode_ = mode;
+    budget_ = &budget;
+    budget_->attach(this);
 }
 
 
-void ThreadPool::setTaskQueMaxThreshold(int threshold)
+int ThreadPool::acquireBudget(int count, bool force)
 {
-    if (checkRunningState())
-        return;
-    taskQueMaxThreshold_ = threshold;
+    if (budget_ == nullptr || count <= 0)
+    {
+        return count;
+    }
+    int granted = budget_->acquire(this, count, force);
+    budgetHeld_ += granted;
+    return granted;
 }
 
 
-void ThreadPool::setThreadMaxThreshold(int threshold)
+void ThreadPool::releaseBudget()
 {
-    if (checkRunningState() || poolMode_ == PoolMode::MODE_FIXED)
-        return;
-    threadMaxThreshold_ = threshold;
+    if (budget_ != nullptr && budgetHeld_ > targetThreadSize_)
+    {
+        budget_->release(budgetHeld_ - targetThreadSize_);
+        budgetHeld_ = targetThreadSize_;
+    }
 }
 
 
 void ThreadPool::start(int initThreadSize)
 {
+    if (budget_ != nullptr)
+    {
+        // 按预算剩余的许可启动，至少一个线程
+        initThreadSize = acquireBudget(initThreadSize, false);
+        if (initThreadSize == 0)
+        {
+            initThreadSize = acquireBudget(1, true);
+        }
+    }
+
     running_ = true;
     initThreadSize_ = initThreadSize;
     currThreadSize_ = initThreadSize;
+    targetThreadSize_ = initThreadSize;
     
     // 创建线程对象
+    // 线程id由所有线程池共享的计数器分配，不一定从0开始，记录本次创建的id
+    std::vector<int> threadIds;
     FOR(i, initThreadSize_)
     {
         // 创建线程对象时，把线程函数传入线程对象
         // std::unique_ptr<Thread> uPtr(new Thread(std::bind(&ThreadPool::threadFunc, this)));
         auto uPtr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
+        threadIds.push_back(uPtr->getId());
         threads_.emplace(uPtr->getId(), std::move(uPtr));    // unique_ptr不允许拷贝构造函数，需要右值引用传递，交换资源
     }
 
     // 启动所有线程
-    FOR(i, initThreadSize_)
+    for (int id : threadIds)
     {
-        threads_[i]->start();   // 要执行线程函数
+        threads_[id]->start();   // 要执行线程函数
         idleThreadSize_++;
     }
+    spawnedThreadSize_ += initThreadSize_;
+
+    // 启动watchdog线程
+    watchdog_ = std::thread(&ThreadPool::watchdogFunc, this);
+
+    // cached模式启动扩缩容控制器线程
+    if (poolMode_ == PoolMode::MODE_CACHED)
+    {
+        scaler_ = std::thread(&ThreadPool::scaleFunc, this);
+    }
+}
+
+
+void ThreadPool::spawnThreads(std::unique_lock<PoolMutex>& lock, int count)
+{
+    // 先占用线程数量，避免其他线程重复扩容
+    idleThreadSize_ += count;
+    currThreadSize_ += count;
+    spawnedThreadSize_ += count;
+
+    // 创建线程是系统调用，在锁外执行，不阻塞提交任务和取任务
+    lock.unlock();
+    std::vector<std::unique_ptr<Thread>> created;
+    FOR(i, count)
+    {
+        auto uPtr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
+        uPtr->start();   // 要执行线程函数
+        created.emplace_back(std::move(uPtr));
+    }
+    lock.lock();
+
+    for (auto& uPtr : created)
+    {
+        threads_.emplace(uPtr->getId(), std::move(uPtr));
+    }
+}
+
+
+void ThreadPool::scaleFunc()
+{
+    int highCount = 0;  // 连续线程不足的采样周期数
+    int lowCount = 0;   // 连续线程过剩的采样周期数
+    int holdCount = 0;  // 剩余的暂停扩容周期数
+    int lastGrow = 0;   // 上一次扩容增加的线程数量
+    double lastThroughput = 0;  // 上一次扩容前的吞吐量
+    uint64_t lastCompleted = completedTaskSize_;
+    auto lastTime = std::chrono::steady_clock::now();
+    auto fastGrowTime = lastTime;   // 下一次允许快速扩容的时间
+
+    // 没有限速的租户中最早入队的任务的入队时间，限速造成的排队增加线程也不能缩短
+    auto oldestHead = [this]() {
+        auto time = std::chrono::steady_clock::time_point::max();
+        for (auto& tenant : tenants_)
+        {
+            if (!tenant->tasks.empty() && tenant->bucket.rate <= 0 && rateBucket_.rate <= 0)
+            {
+                time = std::min(time, tenant->tasks.oldest());
+            }
+        }
+        return time;
+    };
+
+    std::unique_lock<PoolMutex> lock(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_REAP));
+    while (running_)
+    {
+        // 回收空闲超时的多余线程
+        auto reapTime = reapIdleThreads();
+
+        // 快速扩容：排队任务超过空闲线程，且队头任务已经等待超过SCALE_GROW_DELAY_MS时，不等待连续采样
+        // 每SCALE_GROW_DELAY_MS最多翻倍一次，突发负载下线程能及时跟上，排队时间达标的稳定负载不会多创建线程
+        // 爬山法判断线程数量不是瓶颈、暂停扩容期间不走这条路径
+        auto growTime = std::chrono::steady_clock::time_point::max();  // 队头任务等待达到扩容阈值的时间
+        if (holdCount == 0 && static_cast<int>(taskSize_) > idleThreadSize_ && targetThreadSize_ < threadMaxThreshold_)
+        {
+            auto head = oldestHead();
+            if (head != std::chrono::steady_clock::time_point::max())
+            {
+                growTime = std::max(head + std::chrono::milliseconds(SCALE_GROW_DELAY_MS), fastGrowTime);
+            }
+            auto nowTime = std::chrono::steady_clock::now();
+            if (nowTime >= growTime)
+            {
+                int grow = std::min({static_cast<int>(taskSize_) - idleThreadSize_, std::max(1, targetThreadSize_),
+                                     threadMaxThreshold_ - targetThreadSize_});
+                targetThreadSize_ += acquireBudget(grow, false);
+                fastGrowTime = nowTime + std::chrono::milliseconds(SCALE_GROW_DELAY_MS);
+                growTime = fastGrowTime;
+                if (currThreadSize_ < targetThreadSize_)
+                {
+                    spawnThreads(lock, targetThreadSize_ - currThreadSize_);
+                }
+            }
+        }
+
+        // 没有排队任务且线程都空闲时停止采样，只等待下一个空闲线程到期，或submitTask唤醒
+        if (taskSize_ == 0 && idleThreadSize_ == currThreadSize_ && currThreadSize_ <= targetThreadSize_)
+        {
+            if (budget_ != nullptr)
+            {
+                // 注册了预算时按采样周期检查其他线程池的回收请求
+                reapTime = std::min(reapTime, std::chrono::steady_clock::now() + std::chrono::milliseconds(SCALE_INTERVAL_MS));
+            }
+            if (reapTime == std::chrono::steady_clock::time_point::max())
+            {
+                scaleCond_.wait(lock);
+            }
+            else
+            {
+                scaleCond_.wait_until(lock, reapTime);
+            }
+            highCount = lowCount = lastGrow = 0;
+            sojournSum_ = sojournCount_ = 0;
+            lastCompleted = completedTaskSize_;
+            lastTime = std::chrono::steady_clock::now();
+            continue;
+        }
+
+        // 采样周期结束或队头任务等待达到扩容阈值时醒来
+        scaleCond_.wait_until(lock, std::min(std::chrono::steady_clock::now() + std::chrono::milliseconds(SCALE_INTERVAL_MS), growTime));
+        if (!running_)
+        {
+            break;
+        }
+
+        // 采样周期内的吞吐量
+        auto nowTime = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(nowTime - lastTime).count();
+        if (seconds * 1000 < SCALE_INTERVAL_MS / 2)
+        {
+            // 被submitTask唤醒或提前醒来检查快速扩容，采样周期太短，继续采样
+            continue;
+        }
+        uint64_t completed = completedTaskSize_;
+        double throughput = (completed - lastCompleted) / seconds;
+        lastCompleted = completed;
+        lastTime = nowTime;
+
+        // 排队时间取出队任务的平均排队时间和队头任务已等待时间的较大值
+        // 线程全部被占用时没有任务出队，只能从队头任务看出排队时间
+        int64_t delay = sojournCount_ > 0 ? sojournSum_ / sojournCount_ : 0;
+        auto head = oldestHead();
+        if (head != std::chrono::steady_clock::time_point::max())
+        {
+            delay = std::max<int64_t>(delay, std::chrono::duration_cast<std::chrono::nanoseconds>(nowTime - head).count());
+        }
+        sojournSum_ = sojournCount_ = 0;
+
+        // 增长和缩减使用不同的阈值和持续周期，避免突发负载下来回震荡
+        if (delay >= SCALE_GROW_DELAY_MS * 1000000LL)
+        {
+            highCount++;
+            lowCount = 0;
+        }
+        else if (delay <= SCALE_SHRINK_DELAY_MS * 1000000LL && idleThreadSize_ > 0)
+        {
+            lowCount++;
+            highCount = 0;
+        }
+        else
+        {
+            highCount = lowCount = 0;
+        }
+        if (holdCount > 0)
+        {
+            holdCount--;
+        }
+
+        if (highCount >= SCALE_GROW_SAMPLES && targetThreadSize_ < threadMaxThreshold_ && holdCount == 0)
+        {
+            highCount = 0;
+            if (lastGrow > 0 && throughput < lastThroughput * 1.05)
+            {
+                // 爬山法：上一次扩容没有提高吞吐量，瓶颈不在线程数量，暂停扩容
+                lastGrow = 0;
+                holdCount = SCALE_HOLD_SAMPLES;
+            }
+            else
+            {
+                // 按排队任务数量扩容，最多翻倍，突发负载下能快速跟上
+                int grow = std::min<int>(taskSize_, targetThreadSize_);
+                grow = std::max(1, std::min(grow, threadMaxThreshold_ - targetThreadSize_));
+                // 预算的许可不足时少扩容或不扩容，其他线程池回收空闲线程后下次再申请
+                grow = acquireBudget(grow, false);
+                if (grow > 0)
+                {
+                    targetThreadSize_ += grow;
+                    lastGrow = grow;
+                    lastThroughput = throughput;
+                }
+            }
+        }
+        else if (lowCount >= SCALE_SHRINK_SAMPLES && targetThreadSize_ > initThreadSize_)
+        {
+            // 缩容一个线程，由空闲线程自行退出
+            lowCount = 0;
+            lastGrow = 0;
+            targetThreadSize_--;
+            releaseBudget();
+            notEmpty_.notify_all();
+        }
+
+        if (currThreadSize_ < targetThreadSize_)
+        {
+            spawnThreads(lock, targetThreadSize_ - currThreadSize_);
+        }
+    }
+}
+
+
+std::chrono::steady_clock::time_point ThreadPool::reapIdleThreads()
+{
+    auto nowTime = std::chrono::steady_clock::now();
+    int remain = currThreadSize_;
+    // 其他线程池许可不足时，不等空闲超时，回收所有多余的空闲线程归还许可
+    bool shed = budget_ != nullptr && budgetShed_.exchange(false);
+    for (auto& idle : idleList_)
+    {
+        if (remain <= initThreadSize_)
+        {
+            break;
+        }
+        if (idle.retire)
+        {
+            // 已经标记，等待线程自己退出
+            remain--;
+            continue;
+        }
+        auto deadline = idle.idleTime + threadIdleTimeout_;
+        if (deadline > nowTime && !shed)
+        {
+            // 列表按空闲时间排序，后面的线程都还没有到期
+            return deadline;
+        }
+        idle.retire = true;
+        remain--;
+        notEmpty_.notify_all();
+    }
+    return std::chrono::steady_clock::time_point::max();
+}
+
+
+void ThreadPool::watchdogFunc()
+{
+    std::unique_lock<std::mutex> lock(workersMtx_);
+    while (running_)
+    {
+        // 找出已经超时的任务，以及最早的超时时间点
+        auto nowTime = std::chrono::steady_clock::now();
+        auto nextTime = std::chrono::steady_clock::time_point::max();
+        std::vector<std::pair<int, std::shared_ptr<WorkerState>>> expired;
+        for (auto& item : workers_)
+        {
+            auto& worker = item.second;
+            if (!worker->busy || worker->timedOut)
+            {
+                continue;
+            }
+            if (worker->deadline <= nowTime)
+            {
+                worker->timedOut = true;
+                expired.emplace_back(item.first, worker);
+            }
+            else
+            {
+                nextTime = std::min(nextTime, worker->deadline);
+            }
+        }
+
+        if (expired.empty())
+        {
+            // 没有超时任务，等待到最早的超时时间点，或有新的超时任务开始执行
+            if (nextTime == std::chrono::steady_clock::time_point::max())
+            {
+                watchdogCond_.wait(lock);
+            }
+            else
+            {
+                watchdogCond_.wait_until(lock, nextTime);
+            }
+            continue;
+        }
+
+        // 超时任务的等待者和回调都在锁外处理
+        std::vector<std::pair<int, std::chrono::milliseconds>> reports;
+        std::vector<std::function<void(std::exception_ptr)>> aborts;
+        for (auto& item : expired)
+        {
+            auto runTime = std::chrono::duration_cast<std::chrono::milliseconds>(nowTime - item.second->startTime);
+            reports.emplace_back(item.first, runTime);
+            aborts.emplace_back(item.second->abort);
+        }
+        lock.unlock();
+
+        for (auto& abort : aborts)
+        {
+            abort(std::make_exception_ptr(TaskTimeout()));
+        }
+        if (timeoutHandler_)
+        {
+            for (auto& report : reports)
+            {
+                timeoutHandler_(report.first, report.second);
+            }
+        }
+
+        // cached模式下，为每个被卡住的线程补充一个新线程
+        if (timeoutCompensation_ && poolMode_ == PoolMode::MODE_CACHED)
+        {
+            std::unique_lock<PoolMutex> queLock(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_CONTROL));
+            int count = std::min<int>(reports.size(), threadMaxThreshold_ - currThreadSize_);
+            if (count > 0)
+            {
+                // 在锁内提高目标线程数量，线程在锁外创建
+                targetThreadSize_ = std::max<int>(targetThreadSize_, currThreadSize_ + count - blockedThreadSize_);
+                // 补偿超时的线程，许可不足时也要创建
+                acquireBudget(targetThreadSize_ - budgetHeld_, true);
+                spawnThreads(queLock, count);
+            }
+        }
+
+        lock.lock();
+    }
 }
 
 
 void ThreadPool::threadFunc(int threadId)
 { 
-    auto lastLime = std::chrono::high_resolution_clock().now();
+    currPool = this;
+
+    // 登记线程状态，供watchdog检查任务超时
+    auto worker = std::make_shared<WorkerState>();
+#ifdef THREADPOOL_TRACE
+    worker->trace = std::make_shared<TraceBuffer>(threadId);
+#endif
+    POOL_PROBE2(thread__spawn, threadId, poolMode_ == PoolMode::MODE_CACHED);
+    {
+        std::lock_guard<std::mutex> guard(workersMtx_);
+        workers_.emplace(threadId, worker);
+    }
+
     while(1)
     {
         Task task;
+        TenantQueue* tenant = nullptr;  // 任务所属租户
+        auto wakeTime = std::chrono::steady_clock::time_point::max();  // 限速的任务最早可以取出的时间
+        std::chrono::steady_clock::time_point startTime;    // 任务出队时间
+        int64_t queueWait = 0;  // 任务排队时间(ns)
+        bool shed = false;      // 是否因排队时间过长丢弃该任务
+        size_t queueDepth = 0;  // 任务出队后队列中剩余的任务数量
+        bool recordMetrics = metricsEnabled_.load(std::memory_order_relaxed);
         {
             // 获取锁
-            std::unique_lock<std::mutex> lock(taskQueMtx_);
+            std::unique_lock<PoolMutex> lock(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_DEQUEUE));
+
+            // cached模式下，线程空闲时登记到空闲列表，由控制器线程回收，不再每1s唤醒检查
+            bool idle = false;
+            std::list<IdleThread>::iterator idleIt;
 
-            while (taskQue_.size() == 0)
+            while (true)
             {
-                if (!running_)
+                // 线程数量超过期望值（resize缩容或控制器缩容），执行完当前任务后就退出，不再取新任务
+                bool exit = currThreadSize_ > targetThreadSize_ + blockedThreadSize_;
+                if (!exit && (tenant = pickTenant(wakeTime)) != nullptr)
+                {
+                    break;
+                }
+
+                if (!exit)
+                {
+                    // 关闭时限速的任务仍按速率执行完
+                    exit = !running_ && wakeTime == std::chrono::steady_clock::time_point::max();
+                }
+                if (!exit && poolMode_ == PoolMode::MODE_CACHED)
+                {
+                    if (!idle)
+                    {
+                        idleIt = idleList_.insert(idleList_.end(), IdleThread{std::chrono::steady_clock::now(), false});
+                        idle = true;
+                        if (idleList_.size() == 1)
+                        {
+                            // 成为最早到期的空闲线程，通知控制器计算到期时间
+                            scaleCond_.notify_one();
+                        }
+                    }
+
+                    // 空闲超时被标记，回收多余线程（超过initThreadSize_的数量的线程）
+                    exit = idleIt->retire && currThreadSize_ > initThreadSize_;
+                }
+
+                if (exit)
                 {
-                    // 线程池结束运行，释放线程资源
-                    std::cout << "threadId: " << std::this_thread::get_id() << " exit" << std::endl;
+                    // 释放线程资源
+                    if (idle)
+                    {
+                        idleList_.erase(idleIt);
+                    }
                     idleThreadSize_--;
                     currThreadSize_--;
-                    
+                    targetThreadSize_ = std::min<int>(targetThreadSize_, currThreadSize_ - blockedThreadSize_);
+                    releaseBudget();
+                    if (running_)
+                    {
+                        reapedThreadSize_++;
+                    }
+
                     // 把线程从容器中移除
                     threads_.erase(threadId);
+                    removeWorker(threadId);
+                    POOL_PROBE2(thread__exit, threadId, running_.load());
+                    exitCond_.notify_all();
+                    if (wakeTime != std::chrono::steady_clock::time_point::max())
+                    {
+                        // 可能是定时等待令牌的线程退出，由其他空闲线程接替
+                        notEmpty_.notify_all();
+                    }
+
+                    // 释放锁后线程池可能已经析构，之后不能再访问成员
+                    // 日志对象不会析构，只使用局部的threadId，不持锁写日志
+                    lock.unlock();
+                    POOL_LOG(LogLevel::LEVEL_INFO, "threadId: %d exit", threadId);
                     return;
                 }
 
-                if (poolMode_ == PoolMode::MODE_CACHED)
+                if (taskSize_ == 0)
                 {
-                    // cached模式下，需要回收多余线程（超过initThreadSize_的数量的线程），当空闲时间超过60s后，把多余线程销毁
-                    // 每1s检查一次
-                    if (notEmpty_.wait_for(lock, std::chrono::seconds(1)) == std::cv_status::timeout)
-                    {
-                        auto nowTime = std::chrono::high_resolution_clock().now();
-                        auto durTime = std::chrono::duration_cast<std::chrono::seconds>(nowTime - lastLime);
-                        if (durTime.count() > THREAD_MAX_IDLE_TIME_SECOND && currThreadSize_ > initThreadSize_)
-                        {
-                            // 超时返回，回收线程
-                            idleThreadSize_--;
-                            currThreadSize_--;
-                            
-                            // 把线程从容器中移除
-                            threads_.erase(threadId);
-                            std::cout << "threadId: " << std::this_thread::get_id() << " exit" << std::endl;
-                            return;
-                            
-                        }
-                    }
+                    // 队列已清空，排队时间恢复正常
+                    codelFirstAbove_ = std::chrono::steady_clock::time_point();
+                    codelDropping_ = false;
+                }
+
+                if (wakeTime != std::chrono::steady_clock::time_point::max() && (!rateWaiter_ || !running_))
+                {
+                    // 只由一个空闲线程定时等待下一个令牌，避免所有空闲线程同时被唤醒
+                    // 关闭时所有线程都定时等待，取完任务后各自退出，不依赖其他线程通知
+                    rateWaiter_ = true;
+                    notEmpty_.wait_until(lock, wakeTime);
+                    rateWaiter_ = false;
                 }
                 else
                 {
@@ -128,16 +1368,48 @@ void ThreadPool::threadFunc(int threadId)
                 }
             }
 
+            if (idle)
+            {
+                idleList_.erase(idleIt);
+            }
+
             // 空闲任务更新
             idleThreadSize_--;
 
             // 取任务
-            task = std::move(taskQue_.front());
-            taskQue_.pop();
+            task = tenant->tasks.pop();
+            tenant->deficit--;
+            tenant->inflight++;
+            tenant->bucket.take();
+            rateBucket_.take();
             taskSize_--;
 
+            // 统计排队时间，供扩缩容控制器、负载控制和指标使用，都不需要时不读时钟
+            bool scaled = poolMode_ == PoolMode::MODE_CACHED;
+            bool controlled = delayControl_.load(std::memory_order_relaxed) != DelayControl::CONTROL_NONE;
+            if (scaled || controlled || recordMetrics)
+            {
+                startTime = std::chrono::steady_clock::now();
+                queueWait = std::chrono::duration_cast<std::chrono::nanoseconds>(startTime - task.enqueueTime).count();
+            }
+            queueDepth = taskSize_;
+            if (tenant->bucket.rate <= 0 && rateBucket_.rate <= 0)
+            {
+                // 限速造成的排队是有意的，增加线程也不能缩短，不参与扩缩容和负载控制
+                if (scaled)
+                {
+                    sojournSum_ += queueWait;
+                    sojournCount_++;
+                }
+                if (controlled)
+                {
+                    shed = delayControl(startTime, queueWait, task.sheddable);
+                }
+            }
+            POOL_PROBE3(task__dequeue, task.id, queueWait, queueDepth);
+
             // 如果依然有剩余任务，继续通知其他线程执行任务
-            if (taskQue_.size() > 0)
+            if (taskSize_ > 0)
             {
                 notEmpty_.notify_all();
             }
@@ -145,19 +1417,180 @@ void ThreadPool::threadFunc(int threadId)
             notFull_.notify_all();
         }   // 释放锁
 
+        // 在锁外记录指标，直方图只由当前线程写入，不需要加锁
+        if (recordMetrics)
+        {
+            worker->metrics.queueWait.record(queueWait);
+            worker->metrics.queueDepth.record(queueDepth);
+        }
+
         // 运行任务
-        if (task != nullptr)
+        if (task.run != nullptr)
+        {
+            if (task.token.isCancelled())
+            {
+                // 任务在队列中被取消，不再执行，通知等待者
+                cancelledTaskSize_.fetch_add(1, std::memory_order_relaxed);
+                task.abort(std::make_exception_ptr(TaskCancelled()));
+            }
+            else if (shed)
+            {
+                droppedTaskSize_.fetch_add(1, std::memory_order_relaxed);
+                POOL_LOG(LogLevel::LEVEL_WARN, "任务排队时间过长，丢弃队头任务");
+                task.abort(std::make_exception_ptr(TaskDropped()));
+            }
+            else if (task.deadline != std::chrono::steady_clock::time_point::max() &&
+                dropExpired_.load(std::memory_order_relaxed) && std::chrono::steady_clock::now() > task.deadline)
+            {
+                // 任务在队列中已经过期，执行也没有意义，把线程留给其他任务
+                deadlineDropped_.fetch_add(1, std::memory_order_relaxed);
+                task.abort(std::make_exception_ptr(DeadlineExpired()));
+            }
+            else
+            {
+                bool timed = task.timeout.count() > 0;
+                if (timed)
+                {
+                    // 登记任务的开始时间和超时时间点，由watchdog检查
+                    std::lock_guard<std::mutex> guard(workersMtx_);
+                    worker->busy = true;
+                    worker->timedOut = false;
+                    worker->startTime = std::chrono::steady_clock::now();
+                    worker->deadline = worker->startTime + task.timeout;
+                    worker->abort = task.abort;
+                    watchdogCond_.notify_one();
+                }
+
+                bool accounting = cpuAccountingEnabled_.load(std::memory_order_relaxed);
+                bool history = runtimeScheduling_.load(std::memory_order_relaxed);
+                bool deadline = task.deadline != std::chrono::steady_clock::time_point::max();
+
+                currToken = task.token;
+                // 紧挨着执行任务开始计时，登记超时或记录指标的时间不算进标签用量和执行时间历史
+                // 出队后没有做这些工作时直接使用出队时间，少读一次时钟
+                int64_t cpuBegin = accounting ? threadCpuNs() : 0;
+                auto wallBegin = startTime;
+                if ((accounting || history) &&
+                    (timed || recordMetrics || wallBegin == std::chrono::steady_clock::time_point()))
+                {
+                    wallBegin = std::chrono::steady_clock::now();
+                }
+
+                POOL_TRACE(worker->trace, task.label, 'B');
+                POOL_PROBE3(task__start, task.id, threadId, task.label);
+                task.run();
+                POOL_PROBE2(task__finish, task.id, threadId);
+                POOL_TRACE(worker->trace, task.label, 'E');
+                currToken = CancelToken();
+                // 任务结束时间，需要时才读时钟，各项统计共用
+                std::chrono::steady_clock::time_point finishTime;
+                if (accounting || history || deadline || recordMetrics)
+                {
+                    finishTime = std::chrono::steady_clock::now();
+                }
+
+                if (accounting)
+                {
+                    // 按标签累计CPU时间和墙上时间，锁只在轮询时才会竞争
+                    int64_t cpuTime = threadCpuNs() - cpuBegin;
+                    auto wallTime = finishTime - wallBegin;
+                    std::lock_guard<std::mutex> guard(worker->usageMtx);
+                    LabelUsage& usage = worker->usage[task.label];
+                    if (usage.tasks == 0)
+                    {
+                        usage.label = task.label;
+                    }
+                    usage.tasks++;
+                    usage.cpuTime += cpuTime;
+                    usage.wallTime += std::chrono::duration_cast<std::chrono::nanoseconds>(wallTime).count();
+                }
+
+                if (history)
+                {
+                    // 更新执行时间的指数移动平均，新样本权重1/4，任务变长或变短后几次执行就能调整级别
+                    int64_t runTime = std::chrono::duration_cast<std::chrono::nanoseconds>(finishTime - wallBegin).count();
+                    std::lock_guard<std::mutex> guard(historyMtx_);
+                    auto it = runtimeHistory_.find(task.kind);
+                    if (it == runtimeHistory_.end())
+                    {
+                        runtimeHistory_.emplace(task.kind, runTime);
+                    }
+                    else
+                    {
+                        it->second += (runTime - it->second) / 4;
+                    }
+                }
+
+                if (deadline)
+                {
+                    bool met = finishTime <= task.deadline;
+                    (met ? deadlineMet_ : deadlineMissed_).fetch_add(1, std::memory_order_relaxed);
+                }
+
+                if (recordMetrics)
+                {
+                    auto runTime = finishTime - startTime;
+                    worker->metrics.runTime.record(std::chrono::duration_cast<std::chrono::nanoseconds>(runTime).count());
+                }
+                // 只统计实际执行的任务，被取消、丢弃的任务有各自的计数，不影响扩缩容的吞吐量
+                completedTaskSize_.fetch_add(1, std::memory_order_relaxed);
+
+                if (timed)
+                {
+                    std::lock_guard<std::mutex> guard(workersMtx_);
+                    worker->busy = false;
+                    worker->abort = nullptr;
+                }
+            }
+        }
+        if (tenant != nullptr)
         {
-            task();
+            tenant->inflight--;
+            if (tenant->maxInflight > 0)
+            {
+                // 租户释放了一个执行名额，它队列中等待的任务可能可以执行了
+                std::lock_guard<PoolMutex> guard(POOL_LOCK_AT(taskQueMtx_, LockSite::SITE_DEQUEUE));
+                notEmpty_.notify_all();
+            }
         }
-        lastLime = std::chrono::high_resolution_clock().now();  // 更新线程执行完的调度时间
         idleThreadSize_++;
     }   
     return;
 }
 
 
-int Thread::generateId = 0;
+void ThreadPool::removeWorker(int threadId)
+{
+    std::lock_guard<std::mutex> guard(workersMtx_);
+    auto it = workers_.find(threadId);
+    if (it != workers_.end())
+    {
+        // 合并已退出线程的指标
+        retiredMetrics_.merge(it->second->metrics);
+        {
+            std::lock_guard<std::mutex> usageGuard(it->second->usageMtx);
+            for (auto& item : it->second->usage)
+            {
+                LabelUsage& entry = retiredUsage_[item.first];
+                entry.label = item.second.label;
+                entry.merge(item.second);
+            }
+        }
+        if (it->second->trace != nullptr)
+        {
+            // 保留最近退出的线程的轨迹
+            retiredTraces_.push_back(it->second->trace);
+            if (retiredTraces_.size() > TRACE_RETIRED_BUFFER_SIZE)
+            {
+                retiredTraces_.erase(retiredTraces_.begin());
+            }
+        }
+        workers_.erase(it);
+    }
+}
+
+
+std::atomic_int Thread::generateId(0);
 
 
 Thread::Thread() : threadId(generateId++)
@@ -0,0 +1,645 @@
+// threadPool_v2的回归测试，ctest运行，任何一项失败时返回非0
+// 同一份代码还会在定义THREADPOOL_LOCK_PROFILE时再编译一次，覆盖锁统计开启时的析构路径
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "threadpool.hpp"
+#include "strand.hpp"
+#include "executor.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+
+// 占住线程池唯一的工作线程，让之后提交的任务都在队列中排好，再一起放行
+class Gate
+{
+public:
+    explicit Gate(ThreadPool& pool) : future_(promise_.get_future().share())
+    {
+        // 阻塞任务开始执行后才返回，保证后续任务都留在队列中按调度顺序出队
+        auto started = std::make_shared<std::promise<void>>();
+        auto running = started->get_future();
+        auto future = future_;
+        blocker_ = pool.submitTask([started, future]() {
+            started->set_value();
+            future.wait();
+        });
+        running.wait();
+    }
+
+    void open()
+    {
+        promise_.set_value();
+        blocker_.get();
+    }
+
+private:
+    std::promise<void> promise_;
+    std::shared_future<void> future_;
+    std::future<void> blocker_;
+};
+
+
+// 排队时间持续超标时按CoDel丢弃队头任务，sheddable为false的任务照常执行
+static void testDelayControlDrop()
+{
+    ThreadPool pool(4096, 1);
+    pool.setDelayControl(DelayControl::CONTROL_DROP_OLDEST, std::chrono::milliseconds(1), std::chrono::milliseconds(5));
+    pool.start(1);
+
+    TaskOptions keep;
+    keep.sheddable = false;
+    std::vector<std::future<int>> sheddable;
+    std::vector<std::future<int>> kept;
+    auto work = []() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return 1;
+    };
+    for (int i = 0; i < 100; i++)
+    {
+        sheddable.push_back(pool.submitTask(work));
+        kept.push_back(pool.submitTask(keep, work));
+    }
+
+    int dropped = 0;
+    for (auto& f : sheddable)
+    {
+        try
+        {
+            f.get();
+        }
+        catch (const TaskDropped&)
+        {
+            dropped++;
+        }
+    }
+    for (auto& f : kept)
+    {
+        CHECK(f.get() == 1);
+    }
+    CHECK(dropped > 0);
+    MetricsSnapshot snapshot = pool.metrics();
+    CHECK(snapshot.droppedTasks == static_cast<uint64_t>(dropped));
+    CHECK(snapshot.rejectedTasks == 0);
+    // future在任务执行中设置，最后一个任务的完成计数可能还没更新，丢弃的任务不计入完成数量
+    CHECK(snapshot.completedTasks + snapshot.droppedTasks <= 200);
+}
+
+
+// 按排队时间丢弃队头任务时，Strand的批量执行任务不会被丢弃，所有任务都按顺序执行完
+static void testShedUnderStrand()
+{
+    ThreadPool pool(4096, 2);
+    pool.setDelayControl(DelayControl::CONTROL_DROP_OLDEST, std::chrono::milliseconds(1), std::chrono::milliseconds(5));
+    pool.start(2);
+    Strand strand(pool);
+
+    std::mutex mtx;
+    std::vector<int> order;
+    std::vector<std::future<void>> serial;
+    std::vector<std::future<int>> others;
+    for (int i = 0; i < 300; i++)
+    {
+        serial.push_back(strand.submitTask([&, i]() {
+            std::lock_guard<std::mutex> guard(mtx);
+            order.push_back(i);
+        }));
+        // 普通任务让队列持续积压，触发丢弃
+        others.push_back(pool.submitTask([]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            return 1;
+        }));
+    }
+
+    int dropped = 0;
+    for (auto& f : others)
+    {
+        try
+        {
+            f.get();
+        }
+        catch (const TaskDropped&)
+        {
+            dropped++;
+        }
+    }
+    for (auto& f : serial)
+    {
+        f.get();
+    }
+    CHECK(dropped > 0);
+    CHECK(strand.pending() == 0);
+    CHECK(order.size() == 300);
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        CHECK(order[i] == static_cast<int>(i));
+    }
+}
+
+
+// 按排队时间丢弃队头任务时，被丢弃的阶段以TaskDropped结束并沿任务链传递，Executor能正常析构
+static void testShedUnderExecutor()
+{
+    int ok = 0;
+    int dropped = 0;
+    {
+        Executor executor(1, EXECUTOR_IO_MIN_THREADS);
+        executor.cpuPool().setDelayControl(DelayControl::CONTROL_DROP_OLDEST,
+                                           std::chrono::milliseconds(1), std::chrono::milliseconds(5));
+        std::vector<Stage<int>> stages;
+        for (int i = 0; i < 300; i++)
+        {
+            stages.push_back(executor.submitCpu([]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                return 1;
+            }).thenIo([](int v) { return v + 1; }));
+        }
+        for (auto& stage : stages)
+        {
+            try
+            {
+                CHECK(stage.get() == 2);
+                ok++;
+            }
+            catch (const TaskDropped&)
+            {
+                dropped++;
+            }
+        }
+    }
+    CHECK(ok + dropped == 300);
+    CHECK(dropped > 0);
+}
+
+
+// 没有启动的线程池中还有排队的任务（包括等待并发名额的任务）时析构，future得到broken_promise
+static void testDestroyWithQueuedTasks()
+{
+    std::vector<std::future<int>> res;
+    {
+        ThreadPool pool;
+        pool.setLimit("db", 2);
+        for (int i = 0; i < 6; i++)
+        {
+            res.push_back(pool.submitLimited("db", []() { return 1; }));
+        }
+        res.push_back(pool.submitTask([]() { return 2; }));
+    }
+
+    int broken = 0;
+    for (auto& f : res)
+    {
+        try
+        {
+            f.get();
+        }
+        catch (const std::future_error&)
+        {
+            broken++;
+        }
+    }
+    CHECK(broken == 7);
+}
+
+
+// 运行过任务的线程池析构，开启锁统计时还检查统计结果
+static void testDestroyAfterRun()
+{
+    ThreadPool pool(64, 4);
+    pool.start(4);
+    std::vector<std::future<int>> res;
+    for (int i = 0; i < 1000; i++)
+    {
+        res.push_back(pool.submitTask([i]() { return i; }));
+    }
+    long sum = 0;
+    for (auto& f : res)
+    {
+        sum += f.get();
+    }
+    CHECK(sum == 999L * 1000 / 2);
+#ifdef THREADPOOL_LOCK_PROFILE
+    CHECK(!pool.lockProfile().empty());
+#else
+    CHECK(pool.lockProfile().empty());
+#endif
+}
+
+
+// 两个租户都有积压时，按权重3:1轮流取任务
+static void testDrrOrder()
+{
+    ThreadPool pool(64, 1);
+    TenantConfig heavy;
+    heavy.weight = 3;
+    TenantConfig light;
+    light.weight = 1;
+    auto a = pool.createTenant(heavy);
+    auto b = pool.createTenant(light);
+    pool.start(1);
+    Gate gate(pool);
+
+    std::mutex mtx;
+    std::vector<int> order;
+    std::vector<std::future<void>> res;
+    for (int i = 0; i < 12; i++)
+    {
+        res.push_back(a.submitTask([&]() { std::lock_guard<std::mutex> guard(mtx); order.push_back(1); }));
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        res.push_back(b.submitTask([&]() { std::lock_guard<std::mutex> guard(mtx); order.push_back(2); }));
+    }
+    gate.open();
+    for (auto& f : res)
+    {
+        f.get();
+    }
+
+    // 任意连续的一轮（4个任务）中都是3个heavy和1个light
+    CHECK(order.size() == 16);
+    for (size_t round = 0; round + 4 <= order.size(); round += 4)
+    {
+        CHECK(std::count(order.begin() + round, order.begin() + round + 4, 1) == 3);
+    }
+}
+
+
+// 同一租户中有截止时间的任务按截止时间先后执行，先于没有截止时间的任务
+static void testEdfOrder()
+{
+    ThreadPool pool(64, 1);
+    pool.start(1);
+    Gate gate(pool);
+
+    std::mutex mtx;
+    std::vector<int> order;
+    std::vector<std::future<void>> res;
+    auto now = std::chrono::steady_clock::now();
+    res.push_back(pool.submitTask([&]() { std::lock_guard<std::mutex> guard(mtx); order.push_back(0); }));
+    for (int d : {50, 10, 30, 20, 40})
+    {
+        res.push_back(pool.submitWithDeadline(now + std::chrono::seconds(d), [&, d]() {
+            std::lock_guard<std::mutex> guard(mtx);
+            order.push_back(d);
+        }));
+    }
+    gate.open();
+    for (auto& f : res)
+    {
+        f.get();
+    }
+    CHECK((order == std::vector<int>{10, 20, 30, 40, 50, 0}));
+}
+
+
+// 过载时队列中没有截止时间的任务排队超过MLFQ_AGING_MS，有截止时间的任务仍然先执行
+static void testEdfUnderOverload()
+{
+    ThreadPool pool(64, 1);
+    pool.start(1);
+    Gate gate(pool);
+
+    std::mutex mtx;
+    std::vector<int> order;
+    std::vector<std::future<void>> res;
+    for (int i = 0; i < 3; i++)
+    {
+        res.push_back(pool.submitTask([&]() { std::lock_guard<std::mutex> guard(mtx); order.push_back(0); }));
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    for (int i = 1; i <= 3; i++)
+    {
+        res.push_back(pool.submitWithDeadline(deadline + std::chrono::milliseconds(i), [&, i]() {
+            std::lock_guard<std::mutex> guard(mtx);
+            order.push_back(i);
+        }));
+    }
+    // 排队时间超过老化阈值
+    std::this_thread::sleep_for(std::chrono::milliseconds(MLFQ_AGING_MS * 2));
+    gate.open();
+    for (auto& f : res)
+    {
+        f.get();
+    }
+    CHECK((order == std::vector<int>{1, 2, 3, 0, 0, 0}));
+}
+
+
+// 任务执行超时后future得到TaskTimeout，回调报告线程和执行时间；cached模式补偿的线程继续执行后续任务
+static void testTimeoutHandler()
+{
+    ThreadPool pool(64, 2, PoolMode::MODE_CACHED);
+    auto reported = std::make_shared<std::promise<std::chrono::milliseconds>>();
+    pool.setTimeoutHandler([reported](int, std::chrono::milliseconds runTime) {
+        reported->set_value(runTime);
+    });
+    pool.setTimeoutCompensation(true);
+    pool.start(1);
+
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    TaskOptions opts;
+    opts.timeout = std::chrono::milliseconds(20);
+    auto stuck = pool.submitTask(opts, [released]() {
+        released.wait();
+        return 1;
+    });
+    bool timedOut = false;
+    try
+    {
+        stuck.get();
+    }
+    catch (const TaskTimeout&)
+    {
+        timedOut = true;
+    }
+    CHECK(timedOut);
+    CHECK(reported->get_future().get() >= std::chrono::milliseconds(20));
+
+    // 唯一的线程仍被卡住，后续任务由补偿的线程执行
+    auto next = pool.submitTask([]() { return 2; });
+    CHECK(next.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    CHECK(next.get() == 2);
+    CHECK(pool.metrics().spawnedThreads >= 2);
+    release.set_value();
+}
+
+
+// 排队中被取消的任务不执行，future得到TaskCancelled；执行中的任务通过currentToken看到取消请求
+static void testCancellation()
+{
+    ThreadPool pool(64, 1);
+    pool.setMetricsEnabled(true);
+    pool.start(1);
+
+    CancelSource running;
+    TaskOptions runningOpts;
+    runningOpts.token = running.token();
+    std::promise<void> started;
+    auto polling = pool.submitTask(runningOpts, [&started]() {
+        started.set_value();
+        while (!ThreadPool::currentToken().isCancelled())
+        {
+            std::this_thread::yield();
+        }
+        return 1;
+    });
+    started.get_future().wait();
+
+    // 唯一的线程正在执行polling，这个任务留在队列中
+    CancelSource queued;
+    TaskOptions queuedOpts;
+    queuedOpts.token = queued.token();
+    bool ran = false;
+    auto skipped = pool.submitTask(queuedOpts, [&ran]() { ran = true; });
+    queued.cancel();
+    running.cancel();
+
+    CHECK(polling.get() == 1);
+    bool cancelled = false;
+    try
+    {
+        skipped.get();
+    }
+    catch (const TaskCancelled&)
+    {
+        cancelled = true;
+    }
+    CHECK(cancelled);
+    CHECK(!ran);
+    MetricsSnapshot snapshot = pool.metrics();
+    CHECK(snapshot.cancelledTasks == 1);
+    CHECK(snapshot.completedTasks == 1);
+}
+
+
+// cached模式下积压时扩容，空闲超过setThreadIdleTimeout后回收多余线程，不低于初始线程数量
+static void testIdleReaping()
+{
+    ThreadPool pool(1024, 8, PoolMode::MODE_CACHED);
+    pool.setThreadIdleTimeout(std::chrono::seconds(1));
+    pool.start(1);
+
+    std::vector<std::future<void>> res;
+    for (int i = 0; i < 100; i++)
+    {
+        res.push_back(pool.submitTask([]() { std::this_thread::sleep_for(std::chrono::milliseconds(10)); }));
+    }
+    for (auto& f : res)
+    {
+        f.get();
+    }
+    MetricsSnapshot grown = pool.metrics();
+    CHECK(grown.spawnedThreads > 1);
+
+    // 空闲1s后到期，控制器回收多余线程
+    auto limit = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (pool.metrics().reapedThreads < grown.spawnedThreads - 1 && std::chrono::steady_clock::now() < limit)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    CHECK(pool.metrics().reapedThreads == grown.spawnedThreads - 1);
+}
+
+
+// 运行中调整线程数量：扩容后的并发数量达到新值，缩容后多出的线程执行完当前任务退出，并发数量降到新值
+static int maxConcurrency(ThreadPool& pool, int tasks)
+{
+    std::mutex mtx;
+    std::condition_variable cond;
+    int running = 0;
+    int peak = 0;
+    std::vector<std::future<void>> res;
+    for (int i = 0; i < tasks; i++)
+    {
+        res.push_back(pool.submitTask([&]() {
+            std::unique_lock<std::mutex> lock(mtx);
+            running++;
+            peak = std::max(peak, running);
+            cond.notify_all();
+            // 等所有任务同时执行，线程不够时超时结束
+            cond.wait_for(lock, std::chrono::milliseconds(200), [&]() { return peak == tasks; });
+            running--;
+            cond.notify_all();
+        }));
+    }
+    for (auto& f : res)
+    {
+        f.get();
+    }
+    return peak;
+}
+
+static void testLiveResize()
+{
+    ThreadPool pool(64, 8);
+    pool.start(2);
+    CHECK(maxConcurrency(pool, 4) == 2);
+
+    pool.resize(4);
+    CHECK(maxConcurrency(pool, 4) == 4);
+
+    pool.resize(1);
+    CHECK(maxConcurrency(pool, 4) == 1);
+}
+
+
+// 限速后任务按令牌桶的速率取出，第一个任务用掉初始令牌，之后每个任务间隔1/rate
+static void testRateLimit()
+{
+    ThreadPool pool(64, 4);
+    pool.setRateLimit(100, 1);
+    pool.start(4);
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::future<void>> res;
+    for (int i = 0; i < 21; i++)
+    {
+        res.push_back(pool.submitTask([]() {}));
+    }
+    for (auto& f : res)
+    {
+        f.get();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+    // 20个间隔，每个10ms
+    CHECK(elapsed >= std::chrono::milliseconds(190));
+    CHECK(elapsed < std::chrono::seconds(2));
+}
+
+
+// 按执行时间调度时，历史上执行时间短的任务先于排在前面的长任务执行
+static void testMlfqDemotion()
+{
+    ThreadPool pool(64, 1);
+    pool.setRuntimeScheduling(true);
+    pool.start(1);
+
+    TaskOptions slow;
+    slow.label = "slow";
+    TaskOptions fast;
+    fast.label = "fast";
+    // 先各执行一次，记录历史执行时间，slow超过MLFQ_LONG_US被降到长任务级别
+    pool.submitTask(slow, []() { std::this_thread::sleep_for(std::chrono::microseconds(MLFQ_LONG_US * 2)); }).get();
+    pool.submitTask(fast, []() {}).get();
+
+    Gate gate(pool);
+    std::mutex mtx;
+    std::vector<int> order;
+    std::vector<std::future<void>> res;
+    for (int i = 0; i < 3; i++)
+    {
+        res.push_back(pool.submitTask(slow, [&]() { std::lock_guard<std::mutex> guard(mtx); order.push_back(1); }));
+    }
+    res.push_back(pool.submitTask(fast, [&]() { std::lock_guard<std::mutex> guard(mtx); order.push_back(0); }));
+    // 在长任务排队达到MLFQ_AGING_MS之前放行
+    gate.open();
+    for (auto& f : res)
+    {
+        f.get();
+    }
+    CHECK((order == std::vector<int>{0, 1, 1, 1}));
+}
+
+
+// 只有一个线程的fixed线程池中，任务在阻塞区内等待时，线程池补偿一个线程执行其他任务
+static void testBlockingSection()
+{
+    ThreadPool pool(64, 1);
+    pool.start(1);
+
+    std::promise<void> entered;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    auto blocked = pool.submitTask([&entered, released]() {
+        auto section = ThreadPool::blockingSection();
+        entered.set_value();
+        released.wait();
+        return 1;
+    });
+    entered.get_future().wait();
+
+    auto compute = pool.submitTask([]() { return 2; });
+    CHECK(compute.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    CHECK(compute.get() == 2);
+    release.set_value();
+    CHECK(blocked.get() == 1);
+}
+
+
+// 两个cached线程池共享4个线程的预算，同时积压时线程总数不超过预算
+static void testThreadBudget()
+{
+    ThreadBudget budget(4);
+    ThreadPool a(1024, 8, PoolMode::MODE_CACHED);
+    ThreadPool b(1024, 8, PoolMode::MODE_CACHED);
+    a.setBudget(budget);
+    b.setBudget(budget);
+    a.start(1);
+    b.start(1);
+
+    std::vector<std::future<void>> res;
+    auto work = []() { std::this_thread::sleep_for(std::chrono::milliseconds(20)); };
+    for (int i = 0; i < 50; i++)
+    {
+        res.push_back(a.submitTask(work));
+        res.push_back(b.submitTask(work));
+    }
+    int peak = 0;
+    for (auto& f : res)
+    {
+        while (f.wait_for(std::chrono::milliseconds(5)) != std::future_status::ready)
+        {
+            peak = std::max(peak, budget.used());
+        }
+    }
+    CHECK(peak > 2);
+    CHECK(peak <= 4);
+}
+
+
+int main()
+{
+    struct
+    {
+        const char* name;
+        void (*func)();
+    } tests[] = {
+        {"delay_control_drop", testDelayControlDrop},
+        {"shed_under_strand", testShedUnderStrand},
+        {"shed_under_executor", testShedUnderExecutor},
+        {"destroy_with_queued_tasks", testDestroyWithQueuedTasks},
+        {"destroy_after_run", testDestroyAfterRun},
+        {"drr_order", testDrrOrder},
+        {"edf_order", testEdfOrder},
+        {"edf_under_overload", testEdfUnderOverload},
+        {"timeout_handler", testTimeoutHandler},
+        {"cancellation", testCancellation},
+        {"idle_reaping", testIdleReaping},
+        {"live_resize", testLiveResize},
+        {"rate_limit", testRateLimit},
+        {"mlfq_demotion", testMlfqDemotion},
+        {"blocking_section", testBlockingSection},
+        {"thread_budget", testThreadBudget},
+    };
+
+    for (auto& test : tests)
+    {
+        int before = failures;
+        test.func();
+        fprintf(stderr, "%s %s\n", failures == before ? "PASS" : "FAIL", test.name);
+    }
+    return failures == 0 ? 0 : 1;
+}